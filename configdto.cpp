@@ -29,7 +29,16 @@ ConfigDTO::ConfigDTO() {
     this->colorize = false;
     this->keepPaths = false;
     this->colorNodes = false;
+    this->gitIndex = false;
+    this->untracked = false;
+    this->showDepth = false;
     this->mergeMode = MERGE_FILE;
+    this->outputFormat = FORMAT_DOT;
+    this->ioDepth = DEFAULT_IO_DEPTH;
+    this->memoryLimit = 0;
+    this->shardIndex = 0;
+    this->shardCount = 0;
+    this->historyCount = 0;
     this->quoteType = QUOTE_BOTH;
     this->value = 128;
     this->saturation = 128;
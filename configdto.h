@@ -29,6 +29,11 @@
 #define MERGE_MODULE    1
 #define MERGE_DIR       2
 
+#define FORMAT_DOT      0
+#define FORMAT_SVG      1
+
+#define DEFAULT_IO_DEPTH 64
+
 #define QUOTE_BOTH      0
 #define QUOTE_ANGLE     1
 #define QUOTE_QUOTE     2
@@ -37,6 +42,7 @@
 #define PROV_QUOTE      0x02
 #define PROV_VALUE      0x04
 #define PROV_SAT        0x08
+#define PROV_FORMAT     0x10
 
 #define OPT_UNKNOWN -1
 #define OPT_HELP    0
@@ -45,6 +51,9 @@
 #define OPT_IGNMIS  3
 #define OPT_COLOR   4
 #define OPT_KEEP    5
+#define OPT_GIT_INDEX 6
+#define OPT_UNTRACKED 7
+#define OPT_SHOW_DEPTH 8
 #define OPT_EXCLUDE 100
 #define OPT_MERGE   101
 #define OPT_INCLUDE 102
@@ -55,6 +64,15 @@
 #define OPT_SAT     107
 #define OPT_COLOR_NODES 108
 #define OPT_CONFIG  109
+#define OPT_FORMAT  110
+#define OPT_IO_DEPTH 111
+#define OPT_CACHE   112
+#define OPT_IMPACTED 113
+#define OPT_MEMORY_LIMIT 114
+#define OPT_SHARD   115
+#define OPT_MERGE_SHARDS 116
+#define OPT_HISTORY 117
+#define OPT_HISTORY_GRAPHS 118
 
 #define OPT_PARAM   100
 
@@ -68,14 +86,27 @@ public:
     bool colorize;
     bool keepPaths;
     bool colorNodes;
+    bool gitIndex;
+    bool untracked;
+    bool showDepth;
     int mergeMode;
+    int outputFormat;
+    int ioDepth;
+    int memoryLimit;
+    int shardIndex;
+    int shardCount;
+    int historyCount;
     int quoteType;
     int value;
     int saturation;
     QString excludeRegEx;
     QString excludeIncludeRegEx;
     QString srcPath;
+    QString cacheFile;
+    QString impactedBy;
     QStringList includePaths;
+    QStringList shardFiles;
+    QStringList historyGraphs;
     QMap<int, QString> nodeColorMap;
 
     unsigned int cmdProvided;
@@ -8,6 +8,18 @@ QT       += core
 
 QT       -= gui
 
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
+unix:!macx {
+    CONFIG += link_pkgconfig
+    packagesExist(liburing) {
+        PKGCONFIG += liburing
+        DEFINES += HAVE_IO_URING
+    }
+}
+
+LIBS += -lz
+
 TARGET = dep-analyser
 CONFIG   += console
 CONFIG   -= app_bundle
@@ -16,7 +28,25 @@ TEMPLATE = app
 
 
 SOURCES += main.cpp \
-    configdto.cpp
+    configdto.cpp \
+    pathtrie.cpp \
+    svglayout.cpp \
+    filereader.cpp \
+    fileidentity.cpp \
+    gitindex.cpp \
+    scancache.cpp \
+    edgestore.cpp \
+    partialgraph.cpp \
+    gitobjects.cpp
 
 HEADERS += \
-    configdto.h
+    configdto.h \
+    pathtrie.h \
+    svglayout.h \
+    filereader.h \
+    fileidentity.h \
+    gitindex.h \
+    scancache.h \
+    edgestore.h \
+    partialgraph.h \
+    gitobjects.h
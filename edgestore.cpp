@@ -0,0 +1,357 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "edgestore.h"
+
+#include <QDir>
+
+#include <algorithm>
+#include <limits.h>
+
+struct MergeHead {
+    Edge edge;
+    int run;
+
+    //Inverted so the standard max heap yields the smallest edge
+    bool operator<(const MergeHead& other) const {
+        return other.edge < this->edge;
+    }
+};
+
+static void radixPass(QVector<Edge>& edges, QVector<Edge>& scratch, bool source, int shift) {
+    int start[257] = { 0 };
+
+    for(int i = 0; i < edges.count(); i++) {
+        const Edge& edge = edges.at(i);
+        start[(((source ? edge.from : edge.to) >> shift) & 0xFF) + 1]++;
+    }
+    for(int i = 0; i < 256; i++) {
+        start[i + 1] += start[i];
+    }
+    for(int i = 0; i < edges.count(); i++) {
+        const Edge& edge = edges.at(i);
+        scratch[start[((source ? edge.from : edge.to) >> shift) & 0xFF]++] = edge;
+    }
+    edges.swap(scratch);
+}
+
+/*
+ * Least significant digit radix sort by (from, to) followed by removing
+ * duplicates. Only the bytes used by the largest ids are sorted, which keeps
+ * it linear in the number of edges.
+ */
+static void sortEdges(QVector<Edge>& edges) {
+    PathId maxFrom = 0;
+    PathId maxTo = 0;
+
+    for(int i = 0; i < edges.count(); i++) {
+        maxFrom = qMax(maxFrom, edges.at(i).from);
+        maxTo = qMax(maxTo, edges.at(i).to);
+    }
+
+    QVector<Edge> scratch(edges.count());
+    for(int shift = 0; shift < 32 && (maxTo >> shift) != 0; shift += 8) {
+        radixPass(edges, scratch, false, shift);
+    }
+    for(int shift = 0; shift < 32 && (maxFrom >> shift) != 0; shift += 8) {
+        radixPass(edges, scratch, true, shift);
+    }
+    scratch = QVector<Edge>();
+
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+}
+
+static bool writeEdges(QFile* file, const QVector<Edge>& edges) {
+    qint64 size = qint64(edges.count()) * qint64(sizeof(Edge));
+    return file->write(reinterpret_cast<const char*>(edges.constData()), size) == size;
+}
+
+EdgeStore::EdgeStore(qint64 memoryLimit) {
+    //An eighth of the budget per buffer, sorting needs a second copy, the
+    //source and the result of a merge stage are alive at the same time and
+    //path data needs room as well
+    if(memoryLimit > 0) {
+        qint64 edges = memoryLimit / 8 / qint64(sizeof(Edge));
+        this->bufferLimit = int(qBound(qint64(EDGE_BLOCK_SIZE), edges, qint64(INT_MAX / 2)));
+    } else {
+        this->bufferLimit = 0;
+    }
+    this->edgeCount = 0;
+    this->finished = false;
+}
+
+EdgeStore::~EdgeStore() {
+    qDeleteAll(this->runs);
+}
+
+void EdgeStore::insert(PathId from, PathId to) {
+    Q_ASSERT(!this->finished);
+
+    Edge edge;
+    edge.from = from;
+    edge.to = to;
+    this->buffer.append(edge);
+
+    if(this->bufferLimit > 0 && this->buffer.count() >= this->bufferLimit) {
+        spill();
+    }
+}
+
+bool EdgeStore::finish() {
+    if(this->finished) {
+        return this->error.isEmpty();
+    }
+    this->finished = true;
+
+    if(this->runs.isEmpty() && this->error.isEmpty()) {
+        sortEdges(this->buffer);
+        this->edgeCount = this->buffer.count();
+        return true;
+    }
+
+    if(!this->buffer.isEmpty()) {
+        spill();
+    }
+    this->buffer = QVector<Edge>();
+
+    //Merge passes with a bounded fan-in until a single run is left
+    while(this->runs.count() > 1 && this->error.isEmpty()) {
+        QList<QTemporaryFile*> merged;
+        for(int i = 0; i < this->runs.count() && this->error.isEmpty();
+                i += EDGE_MERGE_FANIN) {
+            merged << mergeRuns(this->runs.mid(i, EDGE_MERGE_FANIN));
+        }
+        qDeleteAll(this->runs);
+        this->runs = merged;
+    }
+
+    //A failed store hands out no edges at all
+    if(!this->error.isEmpty()) {
+        qDeleteAll(this->runs);
+        this->runs.clear();
+        return false;
+    }
+    this->edgeCount = this->runs.first()->size() / qint64(sizeof(Edge));
+
+    return true;
+}
+
+void EdgeStore::clear() {
+    //A failure is kept, it is still reported once the store was merged away
+    qDeleteAll(this->runs);
+    this->runs.clear();
+    this->buffer = QVector<Edge>();
+    this->edgeCount = 0;
+    this->finished = false;
+}
+
+QString EdgeStore::errorString() const {
+    return this->error;
+}
+
+qint64 EdgeStore::count() const {
+    return this->edgeCount;
+}
+
+bool EdgeStore::isSpilled() const {
+    return !this->runs.isEmpty();
+}
+
+void EdgeStore::spill() {
+    //After a failure the edges are dropped, finish() reports the error
+    if(!this->error.isEmpty()) {
+        this->buffer.clear();
+        return;
+    }
+
+    sortEdges(this->buffer);
+
+    QTemporaryFile* run = createRun();
+    if(run) {
+        if(!writeEdges(run, this->buffer)) {
+            this->error = "Could not write edge run " + run->fileName();
+        }
+        run->close();
+        this->runs << run;
+    }
+    this->buffer.clear();
+}
+
+QTemporaryFile* EdgeStore::createRun() {
+    QTemporaryFile* run = new QTemporaryFile(QDir::tempPath() + "/dep-analyser-XXXXXX.edges");
+    if(!run->open()) {
+        this->error = "Could not create an edge run in " + QDir::tempPath();
+        delete run;
+        return 0;
+    }
+
+    return run;
+}
+
+QTemporaryFile* EdgeStore::mergeRuns(const QList<QTemporaryFile*>& runs) {
+    QList<EdgeReader*> readers;
+    QVector<MergeHead> heap;
+    QVector<Edge> output;
+    Edge last;
+    bool written = false;
+    QTemporaryFile* merged = createRun();
+
+    if(!merged) {
+        return 0;
+    }
+    last.from = PATH_NONE;
+    last.to = PATH_NONE;
+
+    for(int i = 0; i < runs.count(); i++) {
+        MergeHead head;
+        readers << new EdgeReader(runs.at(i)->fileName());
+        head.run = i;
+        if(readers.last()->next(&head.edge)) {
+            heap << head;
+        }
+    }
+    std::make_heap(heap.begin(), heap.end());
+
+    output.reserve(EDGE_BLOCK_SIZE);
+    while(!heap.isEmpty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        MergeHead& head = heap.last();
+
+        //Runs are free of duplicates, only equal edges of different runs remain
+        if(!written || !(last == head.edge)) {
+            last = head.edge;
+            written = true;
+            output << head.edge;
+            if(output.count() == EDGE_BLOCK_SIZE) {
+                if(!writeEdges(merged, output) && this->error.isEmpty()) {
+                    this->error = "Could not write edge run " + merged->fileName();
+                }
+                output.clear();
+            }
+        }
+
+        if(readers.at(head.run)->next(&head.edge)) {
+            std::push_heap(heap.begin(), heap.end());
+        } else {
+            heap.removeLast();
+        }
+    }
+    if(!writeEdges(merged, output) && this->error.isEmpty()) {
+        this->error = "Could not write edge run " + merged->fileName();
+    }
+    merged->close();
+    foreach(EdgeReader* reader, readers) {
+        if(this->error.isEmpty()) {
+            this->error = reader->errorString();
+        }
+    }
+    qDeleteAll(readers);
+
+    return merged;
+}
+
+EdgeReader::EdgeReader(const EdgeStore& store) {
+    Q_ASSERT(store.finished);
+
+    this->store = &store;
+    this->index = 0;
+    this->blockCount = 0;
+    this->remaining = 0;
+    if(store.runs.isEmpty()) {
+        this->memory = &store.buffer;
+    } else {
+        this->memory = 0;
+        if(openRun(store.runs.first()->fileName()) && this->remaining != store.edgeCount) {
+            fail(QString("Edge run %1 holds %2 edges instead of %3")
+                 .arg(this->file.fileName()).arg(this->remaining).arg(store.edgeCount));
+        }
+    }
+}
+
+EdgeReader::EdgeReader(const QString& runFile) {
+    this->store = 0;
+    this->memory = 0;
+    this->index = 0;
+    this->blockCount = 0;
+    this->remaining = 0;
+    openRun(runFile);
+}
+
+QString EdgeReader::errorString() const {
+    return this->error;
+}
+
+bool EdgeReader::openRun(const QString& runFile) {
+    this->file.setFileName(runFile);
+    if(!this->file.open(QIODevice::ReadOnly)) {
+        fail("Could not open edge run " + runFile);
+        return false;
+    }
+
+    qint64 size = this->file.size();
+    if(size % qint64(sizeof(Edge)) != 0) {
+        fail("Edge run " + runFile + " ends with a partial edge");
+        return false;
+    }
+    this->remaining = size / qint64(sizeof(Edge));
+
+    return true;
+}
+
+void EdgeReader::fail(const QString& message) {
+    //The reader ends here, the store keeps its first error for the caller
+    this->error = message;
+    this->remaining = 0;
+    this->blockCount = 0;
+    this->index = 0;
+    if(this->store && this->store->error.isEmpty()) {
+        this->store->error = message;
+    }
+}
+
+bool EdgeReader::next(Edge* edge) {
+    if(this->memory) {
+        if(this->index >= this->memory->count()) {
+            return false;
+        }
+        *edge = this->memory->at(this->index++);
+        return true;
+    }
+
+    if(this->index == this->blockCount) {
+        if(this->remaining == 0) {
+            return false;
+        }
+
+        //Read whole blocks, a short read is only allowed for the last one
+        int count = int(qMin(this->remaining, qint64(EDGE_BLOCK_SIZE)));
+        qint64 size = qint64(count) * qint64(sizeof(Edge));
+        this->block.resize(count);
+        if(this->file.read(reinterpret_cast<char*>(this->block.data()), size) != size) {
+            fail("Could not read edge run " + this->file.fileName());
+            return false;
+        }
+        this->remaining -= count;
+        this->blockCount = count;
+        this->index = 0;
+    }
+    *edge = this->block.at(this->index++);
+
+    return true;
+}
@@ -0,0 +1,117 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef EDGESTORE_H
+#define EDGESTORE_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QFile>
+#include <QTemporaryFile>
+
+#include "pathtrie.h"
+
+#define EDGE_BLOCK_SIZE     8192
+#define EDGE_MERGE_FANIN    32
+
+struct Edge {
+    PathId from;
+    PathId to;
+
+    bool operator<(const Edge& other) const {
+        return this->from < other.from || (this->from == other.from && this->to < other.to);
+    }
+
+    bool operator==(const Edge& other) const {
+        return this->from == other.from && this->to == other.to;
+    }
+};
+Q_DECLARE_TYPEINFO(Edge, Q_PRIMITIVE_TYPE);
+
+/*
+ * Collects the edges of the dependency graph and hands them out sorted by
+ * (from, to) without duplicates. Without a memory limit the edges are kept in
+ * one vector. With a limit, full buffers are sorted and spilled to temporary
+ * run files which are combined by k-way merge passes in finish(). Both ways
+ * produce the same sequence of edges. A run that can not be written or read
+ * back fails the store, finish() returns false and errorString() tells why.
+ */
+class EdgeStore {
+public:
+    EdgeStore(qint64 memoryLimit = 0);
+    ~EdgeStore();
+
+    void insert(PathId from, PathId to);
+    bool finish();
+    void clear();
+
+    qint64 count() const;
+    bool isSpilled() const;
+    QString errorString() const;
+
+private:
+    friend class EdgeReader;
+
+    Q_DISABLE_COPY(EdgeStore)
+
+    void spill();
+    QTemporaryFile* createRun();
+    QTemporaryFile* mergeRuns(const QList<QTemporaryFile*>& runs);
+
+    int bufferLimit;
+    QVector<Edge> buffer;
+    QList<QTemporaryFile*> runs;
+    qint64 edgeCount;
+    bool finished;
+    mutable QString error;
+};
+
+/*
+ * Sequential reader for a finished EdgeStore or a single run file. A run that
+ * can not be opened, fails to read or ends early stops the reader: next()
+ * returns false and errorString() is set, for a store reader on the store as
+ * well. Callers check the store once they are done, so the output is never
+ * silently truncated.
+ */
+class EdgeReader {
+public:
+    EdgeReader(const EdgeStore& store);
+    EdgeReader(const QString& runFile);
+
+    bool next(Edge* edge);
+    QString errorString() const;
+
+private:
+    Q_DISABLE_COPY(EdgeReader)
+
+    bool openRun(const QString& runFile);
+    void fail(const QString& message);
+
+    const EdgeStore* store;
+    const QVector<Edge>* memory;
+    QFile file;
+    qint64 remaining;
+    QVector<Edge> block;
+    int index;
+    int blockCount;
+    QString error;
+};
+
+#endif // EDGESTORE_H
@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "fileidentity.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+bool FileIdentity::identify(const QString &path, FileId *id, FileStamp *stamp) {
+    //One stat call answers both, whether the file exists and which file it is
+#ifdef Q_OS_UNIX
+    struct stat info;
+    if(stat(QFile::encodeName(path).constData(), &info) != 0) {
+        return false;
+    }
+    if(id) {
+        id->device = quint64(info.st_dev);
+        id->inode = quint64(info.st_ino);
+        id->valid = true;
+    }
+    if(stamp) {
+#ifdef Q_OS_LINUX
+        stamp->mtime = qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#else
+        stamp->mtime = qint64(info.st_mtime) * 1000000000;
+#endif
+        stamp->size = qint64(info.st_size);
+        stamp->hash.clear();
+    }
+
+    return true;
+#else
+    if(id) {
+        *id = FileId();
+    }
+    if(stamp) {
+        QFileInfo info(path);
+        stamp->mtime = info.lastModified().toMSecsSinceEpoch() * 1000000;
+        stamp->size = info.size();
+        stamp->hash.clear();
+    }
+
+    return QFile::exists(path);
+#endif
+}
+
+bool FileIdentity::visitDirectory(const QString &path) {
+    FileId id;
+    if(!identify(path, &id) || !id.valid) {
+        return true;
+    }
+    if(this->directories.contains(id)) {
+        return false;
+    }
+    this->directories.insert(id);
+
+    return true;
+}
+
+bool FileIdentity::isKnown(const FileId &id) const {
+    return id.valid && this->files.contains(id);
+}
+
+PathId FileIdentity::canonical(const FileId &id, PathId alias) {
+    if(!id.valid) {
+        return alias;
+    }
+
+    QHash<FileId, PathId>::const_iterator it = this->files.constFind(id);
+    if(it != this->files.constEnd()) {
+        return it.value();
+    }
+    this->files.insert(id, alias);
+
+    return alias;
+}
+
+PathId FileIdentity::find(const FileId &id) const {
+    if(!id.valid) {
+        return PATH_NONE;
+    }
+
+    return this->files.value(id, PATH_NONE);
+}
+
+QList<FileId> FileIdentity::knownFiles() const {
+    return this->files.keys();
+}
@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef FILEIDENTITY_H
+#define FILEIDENTITY_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QSet>
+
+#include "pathtrie.h"
+
+/*
+ * Physical identity of a file, the device and inode it lives on. Invalid on
+ * platforms without inodes, paths are used as identity there.
+ */
+struct FileId {
+    FileId() : device(0), inode(0), valid(false) {}
+
+    quint64 device;
+    quint64 inode;
+    bool valid;
+
+    bool operator==(const FileId& other) const {
+        return this->device == other.device && this->inode == other.inode
+                && this->valid == other.valid;
+    }
+};
+
+inline uint qHash(const FileId& id) {
+    return qHash(id.inode ^ (id.device * Q_UINT64_C(0x9E3779B97F4A7C15)));
+}
+
+/*
+ * Cheap change detection data of a file, the modification time in
+ * nanoseconds, the size and, if known, the content hash.
+ */
+struct FileStamp {
+    FileStamp() : mtime(0), size(-1) {}
+
+    qint64 mtime;
+    qint64 size;
+    QByteArray hash;
+
+    bool operator==(const FileStamp& other) const {
+        return this->mtime == other.mtime && this->size == other.size
+                && this->hash == other.hash;
+    }
+
+    bool operator!=(const FileStamp& other) const {
+        return !(*this == other);
+    }
+};
+
+/*
+ * Maps all paths reaching the same physical file onto one canonical node and
+ * remembers the directories already scanned, so symlinked directories are
+ * scanned once and symlink loops terminate.
+ */
+class FileIdentity {
+public:
+    static bool identify(const QString& path, FileId* id, FileStamp* stamp = 0);
+
+    bool visitDirectory(const QString& path);
+    bool isKnown(const FileId& id) const;
+    PathId canonical(const FileId& id, PathId alias);
+    PathId find(const FileId& id) const;
+    QList<FileId> knownFiles() const;
+
+private:
+    QSet<FileId> directories;
+    QHash<FileId, PathId> files;
+};
+
+#endif // FILEIDENTITY_H
@@ -0,0 +1,473 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "filereader.h"
+
+#include <QFile>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QRunnable>
+#include <QThreadPool>
+
+#ifdef HAVE_IO_URING
+#include <liburing.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+struct ReadResult {
+    int index;
+    bool failed;
+    QByteArray contents;
+};
+
+struct ReadQueue {
+    QMutex mutex;
+    QWaitCondition ready;
+    QList<ReadResult> done;
+};
+
+class ReadTask : public QRunnable {
+public:
+    ReadTask(const QString& file, int index, ReadQueue* queue) {
+        this->file = file;
+        this->index = index;
+        this->queue = queue;
+    }
+
+    void run() {
+        ReadResult result;
+        QFile currentFile(this->file);
+        result.index = this->index;
+        result.failed = !currentFile.open(QIODevice::ReadOnly);
+        if(!result.failed) {
+            result.contents = currentFile.readAll();
+        }
+
+        QMutexLocker locker(&this->queue->mutex);
+        this->queue->done.append(result);
+        this->queue->ready.wakeOne();
+    }
+
+private:
+    QString file;
+    int index;
+    ReadQueue* queue;
+};
+
+class StatTask : public QRunnable {
+public:
+    StatTask(const QStringList* files, int begin, int end, FileStat* stats) {
+        this->files = files;
+        this->begin = begin;
+        this->end = end;
+        this->stats = stats;
+    }
+
+    void run() {
+        for(int i = this->begin; i < this->end; i++) {
+            FileStat& stat = this->stats[i];
+            stat.exists = FileIdentity::identify(this->files->at(i), &stat.id, &stat.stamp);
+        }
+    }
+
+private:
+    const QStringList* files;
+    int begin;
+    int end;
+    FileStat* stats;
+};
+
+/*
+ * Tracks the first file whose read did not finish yet. Reads are only started
+ * within a window of files behind it.
+ */
+class ReadWindow {
+public:
+    ReadWindow(int count, int depth) : finished(count, false) {
+        this->head = 0;
+        this->size = FILE_READ_AHEAD * depth;
+    }
+
+    bool allows(int index) const {
+        return index < this->head + this->size;
+    }
+
+    void finish(int index) {
+        this->finished[index] = true;
+        while(this->head < this->finished.count() && this->finished.at(this->head)) {
+            this->head++;
+        }
+    }
+
+private:
+    QVector<bool> finished;
+    int head;
+    int size;
+};
+
+/*
+ * Blocking reads on a private thread pool, used where io_uring is not
+ * available.
+ */
+class ThreadFileReader : public FileReader {
+public:
+    ThreadFileReader(int depth) {
+        this->depth = depth;
+    }
+
+    const char* name() const {
+        return "threads";
+    }
+
+    void readFiles(const QStringList& files, FileConsumer& consumer) {
+        ReadQueue queue;
+        QThreadPool pool;
+        ReadWindow window(files.count(), this->depth);
+        int next = 0;
+        int inFlight = 0;
+
+        pool.setMaxThreadCount(this->depth);
+
+        while(next < files.count() || inFlight > 0) {
+            while(inFlight < this->depth && next < files.count() && window.allows(next)) {
+                pool.start(new ReadTask(files.at(next), next, &queue));
+                next++;
+                inFlight++;
+            }
+
+            QList<ReadResult> done;
+            {
+                QMutexLocker locker(&queue.mutex);
+                while(queue.done.isEmpty()) {
+                    queue.ready.wait(&queue.mutex);
+                }
+                done.swap(queue.done);
+            }
+
+            foreach(const ReadResult& result, done) {
+                inFlight--;
+                window.finish(result.index);
+                if(result.failed) {
+                    consumer.fileFailed(result.index);
+                } else {
+                    consumer.fileRead(result.index, result.contents);
+                }
+            }
+        }
+    }
+
+    void statFiles(const QStringList& files, QVector<FileStat>& stats) {
+        QThreadPool pool;
+
+        //Every task owns its own range of the result
+        stats.fill(FileStat(), files.count());
+        FileStat* results = stats.data();
+        pool.setMaxThreadCount(this->depth);
+        for(int i = 0; i < files.count(); i += FILE_STAT_BATCH) {
+            pool.start(new StatTask(&files, i, qMin(i + FILE_STAT_BATCH, files.count()),
+                                    results));
+        }
+        pool.waitForDone();
+    }
+
+private:
+    int depth;
+};
+
+#ifdef HAVE_IO_URING
+
+#define URING_OP_OPEN   0
+#define URING_OP_STATX  1
+#define URING_OP_READ   2
+
+/*
+ * Every file runs through open and statx submitted side by side, followed by
+ * reads until the size reported by statx is reached. Half of the queue depth
+ * is used as the number of files in flight.
+ */
+class UringFileReader : public FileReader {
+public:
+    UringFileReader(int depth) {
+        this->depth = qMax(depth, 2);
+        this->valid = io_uring_queue_init(this->depth, &this->ring, 0) == 0;
+
+        //Kernels before 5.6 set up a ring but reject openat, statx and read
+        if(this->valid && !supportsOpcodes()) {
+            io_uring_queue_exit(&this->ring);
+            this->valid = false;
+        }
+    }
+
+    ~UringFileReader() {
+        if(this->valid) {
+            io_uring_queue_exit(&this->ring);
+        }
+    }
+
+    bool isValid() const {
+        return this->valid;
+    }
+
+    const char* name() const {
+        return "io_uring";
+    }
+
+    void readFiles(const QStringList& files, FileConsumer& consumer) {
+        QVector<Slot> requests(this->depth / 2);
+        QVector<int> freeSlots;
+        ReadWindow window(files.count(), this->depth / 2);
+        int next = 0;
+        int active = 0;
+
+        for(int i = requests.count() - 1; i >= 0; i--) {
+            freeSlots.append(i);
+        }
+
+        while(next < files.count() || active > 0) {
+            while(!freeSlots.isEmpty() && next < files.count() && window.allows(next)) {
+                int s = freeSlots.last();
+                freeSlots.removeLast();
+                Slot& slot = requests[s];
+                slot.index = next++;
+                slot.fd = -1;
+                slot.pending = 2;
+                slot.failed = false;
+                slot.offset = 0;
+                slot.path = QFile::encodeName(files.at(slot.index));
+                slot.buffer.clear();
+
+                struct io_uring_sqe* sqe = nextSqe();
+                io_uring_prep_openat(sqe, AT_FDCWD, slot.path.constData(),
+                                     O_RDONLY | O_CLOEXEC, 0);
+                io_uring_sqe_set_data(sqe, userData(s, URING_OP_OPEN));
+                sqe = nextSqe();
+                io_uring_prep_statx(sqe, AT_FDCWD, slot.path.constData(), 0, STATX_SIZE,
+                                    &slot.stx);
+                io_uring_sqe_set_data(sqe, userData(s, URING_OP_STATX));
+                active++;
+            }
+
+            io_uring_submit_and_wait(&this->ring, 1);
+
+            struct io_uring_cqe* cqe;
+            unsigned head;
+            unsigned seen = 0;
+            io_uring_for_each_cqe(&this->ring, head, cqe) {
+                quintptr data = (quintptr) io_uring_cqe_get_data(cqe);
+                int s = int(data >> 8);
+                Slot& slot = requests[s];
+                bool finished = false;
+
+                switch(int(data & 0xFF)) {
+                    case URING_OP_OPEN:
+                        if(cqe->res < 0) {
+                            slot.failed = true;
+                        } else {
+                            slot.fd = cqe->res;
+                        }
+                        slot.pending--;
+                        break;
+                    case URING_OP_STATX:
+                        if(cqe->res < 0) {
+                            slot.failed = true;
+                        }
+                        slot.pending--;
+                        break;
+                    case URING_OP_READ:
+                        if(cqe->res < 0) {
+                            slot.failed = true;
+                            finished = true;
+                        } else if(cqe->res == 0) {
+                            slot.buffer.truncate(int(slot.offset));
+                            finished = true;
+                        } else {
+                            slot.offset += cqe->res;
+                            if(slot.offset < slot.buffer.size()) {
+                                prepareRead(slot, s);
+                            } else {
+                                finished = true;
+                            }
+                        }
+                        break;
+                }
+
+                //Open and statx are both done, start reading
+                if(int(data & 0xFF) != URING_OP_READ && slot.pending == 0) {
+                    if(slot.failed || slot.stx.stx_size == 0) {
+                        finished = true;
+                    } else {
+                        slot.buffer.resize(int(slot.stx.stx_size));
+                        prepareRead(slot, s);
+                    }
+                }
+
+                if(finished) {
+                    if(slot.fd >= 0) {
+                        close(slot.fd);
+                    }
+                    window.finish(slot.index);
+                    if(slot.failed) {
+                        consumer.fileFailed(slot.index);
+                    } else {
+                        consumer.fileRead(slot.index, slot.buffer);
+                    }
+                    slot.buffer.clear();
+                    freeSlots.append(s);
+                    active--;
+                }
+                seen++;
+            }
+            io_uring_cq_advance(&this->ring, seen);
+        }
+    }
+
+    void statFiles(const QStringList& files, QVector<FileStat>& stats) {
+        QVector<StatSlot> requests(this->depth);
+        QVector<int> freeSlots;
+        int next = 0;
+        int active = 0;
+
+        stats.fill(FileStat(), files.count());
+        for(int i = requests.count() - 1; i >= 0; i--) {
+            freeSlots.append(i);
+        }
+
+        while(next < files.count() || active > 0) {
+            while(!freeSlots.isEmpty() && next < files.count()) {
+                int s = freeSlots.last();
+                freeSlots.removeLast();
+                StatSlot& slot = requests[s];
+                slot.index = next++;
+                slot.path = QFile::encodeName(files.at(slot.index));
+
+                struct io_uring_sqe* sqe = nextSqe();
+                io_uring_prep_statx(sqe, AT_FDCWD, slot.path.constData(), 0,
+                                    STATX_BASIC_STATS, &slot.stx);
+                io_uring_sqe_set_data(sqe, userData(s, URING_OP_STATX));
+                active++;
+            }
+
+            io_uring_submit_and_wait(&this->ring, 1);
+
+            struct io_uring_cqe* cqe;
+            unsigned head;
+            unsigned seen = 0;
+            io_uring_for_each_cqe(&this->ring, head, cqe) {
+                int s = int(((quintptr) io_uring_cqe_get_data(cqe)) >> 8);
+                const StatSlot& slot = requests.at(s);
+                FileStat& stat = stats[slot.index];
+
+                //Same values as stat(), which glibc implements with statx
+                stat.exists = cqe->res >= 0;
+                if(stat.exists) {
+                    stat.id.device = quint64(makedev(slot.stx.stx_dev_major,
+                                                     slot.stx.stx_dev_minor));
+                    stat.id.inode = quint64(slot.stx.stx_ino);
+                    stat.id.valid = true;
+                    stat.stamp.mtime = qint64(slot.stx.stx_mtime.tv_sec) * 1000000000
+                            + slot.stx.stx_mtime.tv_nsec;
+                    stat.stamp.size = qint64(slot.stx.stx_size);
+                }
+                freeSlots.append(s);
+                active--;
+                seen++;
+            }
+            io_uring_cq_advance(&this->ring, seen);
+        }
+    }
+
+private:
+    struct StatSlot {
+        int index;
+        QByteArray path;
+        struct statx stx;
+    };
+
+    struct Slot {
+        int index;
+        int fd;
+        int pending;
+        bool failed;
+        qint64 offset;
+        QByteArray path;
+        QByteArray buffer;
+        struct statx stx;
+    };
+
+    bool supportsOpcodes() {
+        struct io_uring_probe* probe = io_uring_get_probe_ring(&this->ring);
+        if(!probe) {
+            return false;
+        }
+
+        bool supported = io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+                && io_uring_opcode_supported(probe, IORING_OP_STATX)
+                && io_uring_opcode_supported(probe, IORING_OP_READ);
+        io_uring_free_probe(probe);
+
+        return supported;
+    }
+
+    static void* userData(int slot, int op) {
+        return (void*) ((quintptr(slot) << 8) | quintptr(op));
+    }
+
+    struct io_uring_sqe* nextSqe() {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&this->ring);
+        while(!sqe) {
+            io_uring_submit(&this->ring);
+            sqe = io_uring_get_sqe(&this->ring);
+        }
+
+        return sqe;
+    }
+
+    void prepareRead(Slot& slot, int s) {
+        struct io_uring_sqe* sqe = nextSqe();
+        io_uring_prep_read(sqe, slot.fd, slot.buffer.data() + slot.offset,
+                           unsigned(slot.buffer.size() - slot.offset), quint64(slot.offset));
+        io_uring_sqe_set_data(sqe, userData(s, URING_OP_READ));
+    }
+
+    struct io_uring ring;
+    bool valid;
+    int depth;
+};
+
+#endif
+
+FileReader* FileReader::create(int depth) {
+    depth = qMax(depth, 1);
+
+#ifdef HAVE_IO_URING
+    UringFileReader* reader = new UringFileReader(depth);
+    if(reader->isValid()) {
+        return reader;
+    }
+    delete reader;
+#endif
+
+    return new ThreadFileReader(depth);
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef FILEREADER_H
+#define FILEREADER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+
+#include "fileidentity.h"
+
+#define FILE_READ_AHEAD     4
+#define FILE_STAT_BATCH     64
+
+/*
+ * Result of FileReader::statFiles for one file, the same data
+ * FileIdentity::identify returns.
+ */
+struct FileStat {
+    FileStat() : exists(false) {}
+
+    bool exists;
+    FileId id;
+    FileStamp stamp;
+};
+
+/*
+ * Receives the contents of the files handed to a FileReader. The callbacks
+ * are always invoked on the thread calling FileReader::readFiles, in the
+ * order the reads complete.
+ */
+class FileConsumer {
+public:
+    virtual ~FileConsumer() {}
+
+    virtual void fileRead(int index, const QByteArray& contents) = 0;
+    virtual void fileFailed(int index) = 0;
+};
+
+/*
+ * Reads whole files while keeping up to depth requests in flight. The
+ * io_uring backend batches the open, statx and read calls in one ring, the
+ * fallback reads the files on a pool of blocking threads. No file more than
+ * FILE_READ_AHEAD * depth places behind the first unfinished one is started,
+ * so a consumer holding back early arrivals buffers a bounded number of files.
+ * statFiles() stats a list of files with the same concurrency.
+ */
+class FileReader {
+public:
+    virtual ~FileReader() {}
+
+    virtual const char* name() const = 0;
+    virtual void readFiles(const QStringList& files, FileConsumer& consumer) = 0;
+    virtual void statFiles(const QStringList& files, QVector<FileStat>& stats) = 0;
+
+    static FileReader* create(int depth);
+};
+
+#endif // FILEREADER_H
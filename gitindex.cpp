@@ -0,0 +1,182 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "gitindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QtEndian>
+
+#define GIT_INDEX_HEADER        12
+#define GIT_INDEX_STAT_SIZE     40
+#define GIT_FLAG_EXTENDED       0x4000
+#define GIT_FLAG_STAGE_SHIFT    12
+#define GIT_FLAG_NAME_MASK      0x0FFF
+
+QString GitIndex::findGitDir(const QString &path, QString *workTree) {
+    QDir dir(path);
+
+    while(true) {
+        QFileInfo info(dir.absoluteFilePath(".git"));
+        if(info.isDir()) {
+            if(workTree) {
+                *workTree = dir.absolutePath();
+            }
+            return info.absoluteFilePath();
+        }
+        if(info.isFile()) {
+            //Worktrees and submodules use a file pointing to the real git dir
+            QFile link(info.absoluteFilePath());
+            if(link.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                QString line = QString::fromUtf8(link.readLine()).trimmed();
+                if(line.startsWith("gitdir:")) {
+                    if(workTree) {
+                        *workTree = dir.absolutePath();
+                    }
+                    return QDir::cleanPath(dir.absoluteFilePath(line.mid(7).trimmed()));
+                }
+            }
+        }
+        if(!dir.cdUp()) {
+            return QString();
+        }
+    }
+}
+
+QString GitIndex::commonDir(const QString &gitDir) {
+    QFile common(gitDir + "/commondir");
+    if(common.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QString path = QString::fromUtf8(common.readLine()).trimmed();
+        return QDir::cleanPath(QDir(gitDir).absoluteFilePath(path));
+    }
+
+    return gitDir;
+}
+
+int GitIndex::hashSize(const QString &gitDir) {
+    QFile config(commonDir(gitDir) + "/config");
+    QRegExp objectFormat("^\\s*objectformat\\s*=\\s*sha256\\s*$", Qt::CaseInsensitive);
+
+    if(config.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        while(!config.atEnd()) {
+            QString line = QString::fromUtf8(config.readLine()).trimmed();
+            if(objectFormat.indexIn(line) != -1) {
+                return 32;
+            }
+        }
+    }
+
+    return 20;
+}
+
+bool GitIndex::read(const QString &indexFile, int hashSize, QString *error) {
+    QFile file(indexFile);
+    this->indexEntries.clear();
+
+    if(!file.open(QIODevice::ReadOnly)) {
+        *error = "Could not read " + indexFile;
+        return false;
+    }
+    QByteArray data = file.readAll();
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    int size = data.size() - hashSize;
+
+    if(size < GIT_INDEX_HEADER || !data.startsWith("DIRC")) {
+        *error = indexFile + " is not a git index";
+        return false;
+    }
+    quint32 version = qFromBigEndian<quint32>(bytes + 4);
+    quint32 count = qFromBigEndian<quint32>(bytes + 8);
+    if(version < 2 || version > 4) {
+        *error = QString("Unsupported git index version %1").arg(version);
+        return false;
+    }
+
+    int pos = GIT_INDEX_HEADER;
+    QByteArray previous;
+    for(quint32 i = 0; i < count; i++) {
+        int start = pos;
+        if(pos + GIT_INDEX_STAT_SIZE + hashSize + 2 > size) {
+            *error = indexFile + " is truncated";
+            return false;
+        }
+
+        GitIndexEntry entry;
+        qint64 mtime = qFromBigEndian<quint32>(bytes + pos + 8);
+        qint64 mtimeNsec = qFromBigEndian<quint32>(bytes + pos + 12);
+        entry.mode = qFromBigEndian<quint32>(bytes + pos + 24);
+        entry.stamp.mtime = mtime * 1000000000 + mtimeNsec;
+        entry.stamp.size = qFromBigEndian<quint32>(bytes + pos + 36);
+        entry.stamp.hash = data.mid(pos + GIT_INDEX_STAT_SIZE, hashSize);
+        pos += GIT_INDEX_STAT_SIZE + hashSize;
+
+        quint16 flags = qFromBigEndian<quint16>(bytes + pos);
+        entry.stage = (flags >> GIT_FLAG_STAGE_SHIFT) & 0x3;
+        pos += 2;
+        if((flags & GIT_FLAG_EXTENDED) && version >= 3) {
+            pos += 2;
+        }
+
+        QByteArray name;
+        if(version >= 4) {
+            //Prefix compressed: strip N bytes of the previous path, then append
+            int strip = 0;
+            uchar byte;
+            do {
+                if(pos >= size) {
+                    *error = indexFile + " is truncated";
+                    return false;
+                }
+                byte = bytes[pos++];
+                strip = (strip << 7) | (byte & 0x7F);
+                if(byte & 0x80) {
+                    strip++;
+                }
+            } while(byte & 0x80);
+            int end = data.indexOf('\0', pos);
+            if(end == -1 || end >= size || strip > previous.size()) {
+                *error = indexFile + " is corrupt";
+                return false;
+            }
+            name = previous.left(previous.size() - strip) + data.mid(pos, end - pos);
+            pos = end + 1;
+        } else {
+            int end = data.indexOf('\0', pos);
+            if(end == -1 || end >= size) {
+                *error = indexFile + " is corrupt";
+                return false;
+            }
+            name = data.mid(pos, end - pos);
+            //Entries are padded with 1-8 NUL bytes to a multiple of eight
+            pos = start + ((end - start + 8) & ~7);
+        }
+        previous = name;
+
+        entry.path = QString::fromUtf8(name);
+        this->indexEntries.append(entry);
+    }
+
+    return true;
+}
+
+const QList<GitIndexEntry>& GitIndex::entries() const {
+    return this->indexEntries;
+}
@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef GITINDEX_H
+#define GITINDEX_H
+
+#include <QString>
+#include <QList>
+
+#include "fileidentity.h"
+
+#define GIT_MODE_TYPE_MASK  0170000
+#define GIT_MODE_TREE       0040000
+#define GIT_MODE_FILE       0100000
+#define GIT_MODE_SYMLINK    0120000
+#define GIT_MODE_GITLINK    0160000
+
+struct GitIndexEntry {
+    QString path;
+    quint32 mode;
+    int stage;
+    FileStamp stamp;
+};
+
+/*
+ * Reader for the index file of a git repository (".git/index", versions 2
+ * to 4). The index lists the tracked files together with the stat data git
+ * saw when it last refreshed them and the hash of the staged content, which
+ * is enough to enumerate and change check a tree without touching it.
+ */
+class GitIndex {
+public:
+    static QString findGitDir(const QString& path, QString* workTree);
+    static QString commonDir(const QString& gitDir);
+    static int hashSize(const QString& gitDir);
+
+    bool read(const QString& indexFile, int hashSize, QString* error);
+    const QList<GitIndexEntry>& entries() const;
+
+private:
+    QList<GitIndexEntry> indexEntries;
+};
+
+#endif // GITINDEX_H
@@ -0,0 +1,514 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "gitobjects.h"
+#include "gitindex.h"
+
+#include <QDir>
+#include <QStringList>
+#include <QRegExp>
+#include <QtEndian>
+
+#include <zlib.h>
+#include <limits.h>
+#include <string.h>
+
+#define GIT_IDX_MAGIC       0xFF744F63
+#define GIT_IDX_HEADER      8
+#define GIT_IDX_FANOUT      (256 * 4)
+#define GIT_PACK_HEADER     12
+#define GIT_MAX_DELTA_DEPTH 4096
+#define GIT_MAX_REF_DEPTH   8
+
+static bool inflateBytes(const uchar* data, qint64 available, qint64 size, QByteArray* out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(size > INT_MAX || inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+
+    out->resize(int(size));
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = uInt(qMin(available, qint64(UINT_MAX)));
+    stream.next_out = reinterpret_cast<Bytef*>(out->data());
+    stream.avail_out = uInt(size);
+    int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+
+    return result == Z_STREAM_END && qint64(stream.total_out) == size;
+}
+
+static bool inflateAll(const QByteArray& compressed, QByteArray* out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+
+    //Loose objects do not store their inflated size outside the stream
+    out->resize(qMax(compressed.size() * 2, 1024));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.constData()));
+    stream.avail_in = uInt(compressed.size());
+    int result = Z_OK;
+    while(result == Z_OK) {
+        if(int(stream.total_out) == out->size()) {
+            out->resize(out->size() * 2);
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(out->data()) + stream.total_out;
+        stream.avail_out = uInt(out->size()) - uInt(stream.total_out);
+        result = inflate(&stream, Z_NO_FLUSH);
+    }
+    out->resize(int(stream.total_out));
+    inflateEnd(&stream);
+
+    return result == Z_STREAM_END;
+}
+
+static bool deltaSize(const uchar** pos, const uchar* end, qint64* size) {
+    int shift = 0;
+    uchar c;
+
+    *size = 0;
+    do {
+        if(*pos >= end || shift > 56) {
+            return false;
+        }
+        c = *(*pos)++;
+        *size |= qint64(c & 0x7F) << shift;
+        shift += 7;
+    } while(c & 0x80);
+
+    return true;
+}
+
+static bool applyDelta(const QByteArray& base, const QByteArray& delta, QByteArray* result) {
+    const uchar* pos = reinterpret_cast<const uchar*>(delta.constData());
+    const uchar* end = pos + delta.size();
+    qint64 baseSize;
+    qint64 resultSize;
+
+    if(!deltaSize(&pos, end, &baseSize) || !deltaSize(&pos, end, &resultSize)
+            || baseSize != base.size() || resultSize > INT_MAX) {
+        return false;
+    }
+
+    result->resize(int(resultSize));
+    char* out = result->data();
+    qint64 written = 0;
+    while(pos < end) {
+        uchar op = *pos++;
+        if(op & 0x80) {
+            //Copy from the base, offset and size bytes are present per flag bit
+            quint32 offset = 0;
+            quint32 size = 0;
+            for(int i = 0; i < 4; i++) {
+                if(op & (1 << i)) {
+                    if(pos >= end) {
+                        return false;
+                    }
+                    offset |= quint32(*pos++) << (8 * i);
+                }
+            }
+            for(int i = 0; i < 3; i++) {
+                if(op & (0x10 << i)) {
+                    if(pos >= end) {
+                        return false;
+                    }
+                    size |= quint32(*pos++) << (8 * i);
+                }
+            }
+            if(size == 0) {
+                size = 0x10000;
+            }
+            if(qint64(offset) + size > baseSize || written + size > resultSize) {
+                return false;
+            }
+            memcpy(out + written, base.constData() + offset, size);
+            written += size;
+        } else if(op != 0) {
+            //Insert the next op bytes of the delta
+            if(end - pos < op || written + op > resultSize) {
+                return false;
+            }
+            memcpy(out + written, pos, op);
+            pos += op;
+            written += op;
+        } else {
+            return false;
+        }
+    }
+
+    return written == resultSize;
+}
+
+GitObjectStore::GitObjectStore() {
+    this->hashBytes = 20;
+    this->cache.setMaxCost(GIT_OBJECT_CACHE);
+}
+
+GitObjectStore::~GitObjectStore() {
+    foreach(const Pack& pack, this->packs) {
+        delete pack.index;
+        delete pack.data;
+    }
+}
+
+bool GitObjectStore::open(const QString &gitDir, QString *error) {
+    this->gitDir = gitDir;
+    this->commonDir = GitIndex::commonDir(gitDir);
+    this->hashBytes = GitIndex::hashSize(gitDir);
+
+    if(!QDir(this->commonDir + "/objects").exists()) {
+        *error = "No object database in " + this->commonDir;
+        return false;
+    }
+
+    QDir packDir(this->commonDir + "/objects/pack");
+    QStringList indexFiles = packDir.entryList(QStringList() << "*.idx", QDir::Files);
+    foreach(const QString& indexFile, indexFiles) {
+        if(!openPack(packDir.absoluteFilePath(indexFile))) {
+            *error = "Could not read pack " + packDir.absoluteFilePath(indexFile);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int GitObjectStore::hashSize() const {
+    return this->hashBytes;
+}
+
+QByteArray GitObjectStore::resolve(const QString &ref) const {
+    QRegExp hex(QString("[0-9a-fA-F]{%1}").arg(this->hashBytes * 2));
+    QString name = ref;
+
+    for(int depth = 0; depth < GIT_MAX_REF_DEPTH; depth++) {
+        if(hex.exactMatch(name)) {
+            return QByteArray::fromHex(name.toLatin1());
+        }
+
+        //Per worktree refs like HEAD first, then the shared loose and packed refs
+        QString value;
+        QFile refFile(this->gitDir + "/" + name);
+        if(!refFile.exists()) {
+            refFile.setFileName(this->commonDir + "/" + name);
+        }
+        if(refFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            value = QString::fromUtf8(refFile.readLine()).trimmed();
+        } else {
+            QFile packedRefs(this->commonDir + "/packed-refs");
+            if(packedRefs.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                while(!packedRefs.atEnd() && value.isEmpty()) {
+                    QString line = QString::fromUtf8(packedRefs.readLine()).trimmed();
+                    if(!line.startsWith('#') && !line.startsWith('^')
+                            && line.section(' ', 1) == name) {
+                        value = line.section(' ', 0, 0);
+                    }
+                }
+            }
+        }
+
+        if(value.startsWith("ref:")) {
+            name = value.mid(4).trimmed();
+        } else if(hex.exactMatch(value)) {
+            name = value;
+        } else {
+            return QByteArray();
+        }
+    }
+
+    return QByteArray();
+}
+
+bool GitObjectStore::read(const QByteArray &hash, int *type, QByteArray *data) {
+    return readObject(hash, type, data, 0);
+}
+
+bool GitObjectStore::readObject(const QByteArray &hash, int *type, QByteArray *data,
+                                int depth) {
+    if(hash.size() != this->hashBytes) {
+        return false;
+    }
+
+    for(int i = 0; i < this->packs.count(); i++) {
+        qint64 offset = findPacked(this->packs.at(i), hash);
+        if(offset >= 0) {
+            return readPacked(i, offset, type, data, depth);
+        }
+    }
+
+    return readLoose(hash, type, data);
+}
+
+bool GitObjectStore::readCommit(const QByteArray &hash, GitCommit *commit) {
+    int type;
+    QByteArray data;
+
+    if(!read(hash, &type, &data) || type != GIT_OBJ_COMMIT) {
+        return false;
+    }
+
+    int end = data.indexOf("\n\n");
+    if(end == -1) {
+        end = data.size();
+    }
+    commit->tree.clear();
+    commit->parents.clear();
+    commit->time = 0;
+    foreach(const QByteArray& line, data.left(end).split('\n')) {
+        if(line.startsWith("tree ")) {
+            commit->tree = QByteArray::fromHex(line.mid(5));
+        } else if(line.startsWith("parent ")) {
+            commit->parents << QByteArray::fromHex(line.mid(7));
+        } else if(line.startsWith("committer ")) {
+            //Name <mail> seconds timezone
+            QList<QByteArray> parts = line.split(' ');
+            if(parts.count() >= 3) {
+                commit->time = parts.at(parts.count() - 2).toLongLong();
+            }
+        }
+    }
+    QByteArray message = data.mid(end + 2);
+    commit->subject = QString::fromUtf8(message.left(message.indexOf('\n')));
+
+    return commit->tree.size() == this->hashBytes;
+}
+
+bool GitObjectStore::readTree(const QByteArray &hash, QList<GitTreeEntry> *entries) {
+    int type;
+    QByteArray data;
+
+    entries->clear();
+    if(!read(hash, &type, &data) || type != GIT_OBJ_TREE) {
+        return false;
+    }
+
+    //Entries are "<octal mode> <name>\0<binary hash>"
+    int pos = 0;
+    while(pos < data.size()) {
+        int space = data.indexOf(' ', pos);
+        int nul = space == -1 ? -1 : data.indexOf('\0', space);
+        bool converted;
+        if(nul == -1 || nul + 1 + this->hashBytes > data.size()) {
+            return false;
+        }
+
+        GitTreeEntry entry;
+        entry.mode = data.mid(pos, space - pos).toUInt(&converted, 8);
+        entry.name = QString::fromUtf8(data.constData() + space + 1, nul - space - 1);
+        entry.hash = data.mid(nul + 1, this->hashBytes);
+        if(!converted) {
+            return false;
+        }
+        *entries << entry;
+        pos = nul + 1 + this->hashBytes;
+    }
+
+    return true;
+}
+
+bool GitObjectStore::openPack(const QString &indexFile) {
+    Pack pack;
+    pack.index = new QFile(indexFile);
+    pack.data = new QFile(indexFile.left(indexFile.length() - 4) + ".pack");
+    pack.indexMap = 0;
+    pack.dataMap = 0;
+
+    if(pack.index->open(QIODevice::ReadOnly) && pack.data->open(QIODevice::ReadOnly)) {
+        qint64 indexSize = pack.index->size();
+        pack.dataSize = pack.data->size();
+        pack.indexMap = pack.index->map(0, indexSize);
+        pack.dataMap = pack.data->map(0, pack.dataSize);
+
+        if(pack.indexMap && pack.dataMap && indexSize >= GIT_IDX_HEADER + GIT_IDX_FANOUT
+                && pack.dataSize >= GIT_PACK_HEADER
+                && qFromBigEndian<quint32>(pack.indexMap) == GIT_IDX_MAGIC
+                && qFromBigEndian<quint32>(pack.indexMap + 4) == 2
+                && memcmp(pack.dataMap, "PACK", 4) == 0) {
+            pack.count = qFromBigEndian<quint32>(pack.indexMap + GIT_IDX_HEADER
+                                                 + GIT_IDX_FANOUT - 4);
+            //Names, CRCs and small offsets have to fit, large offsets are checked on use
+            if(GIT_IDX_HEADER + GIT_IDX_FANOUT + qint64(pack.count) * (this->hashBytes + 8)
+                    <= indexSize) {
+                this->packs << pack;
+                return true;
+            }
+        }
+    }
+
+    delete pack.index;
+    delete pack.data;
+
+    return false;
+}
+
+qint64 GitObjectStore::findPacked(const Pack &pack, const QByteArray &hash) const {
+    const uchar* fanout = pack.indexMap + GIT_IDX_HEADER;
+    const uchar* names = fanout + GIT_IDX_FANOUT;
+    int first = uchar(hash.at(0));
+    quint32 low = first == 0 ? 0 : qFromBigEndian<quint32>(fanout + (first - 1) * 4);
+    quint32 high = qFromBigEndian<quint32>(fanout + first * 4);
+
+    while(low < high) {
+        quint32 middle = low + (high - low) / 2;
+        int order = memcmp(names + qint64(middle) * this->hashBytes, hash.constData(),
+                           this->hashBytes);
+        if(order == 0) {
+            const uchar* offsets = names + qint64(pack.count) * (this->hashBytes + 4);
+            quint32 offset = qFromBigEndian<quint32>(offsets + qint64(middle) * 4);
+            if(!(offset & 0x80000000)) {
+                return offset;
+            }
+
+            //Offsets beyond 2 GB live in a table of 64 bit values
+            const uchar* large = offsets + qint64(pack.count) * 4
+                    + qint64(offset & 0x7FFFFFFF) * 8;
+            if(large + 8 > pack.indexMap + pack.index->size()) {
+                return -1;
+            }
+            return qint64(qFromBigEndian<quint64>(large));
+        } else if(order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return -1;
+}
+
+bool GitObjectStore::readPacked(int pack, qint64 offset, int *type, QByteArray *data,
+                                int depth) {
+    quint64 key = (quint64(pack) << 48) | quint64(offset);
+    CachedObject* cached = this->cache.object(key);
+    if(cached) {
+        *type = cached->type;
+        *data = cached->data;
+        return true;
+    }
+
+    const Pack& current = this->packs.at(pack);
+    const uchar* bytes = current.dataMap;
+    qint64 end = current.dataSize - this->hashBytes;
+    qint64 pos = offset;
+    if(depth > GIT_MAX_DELTA_DEPTH || offset < GIT_PACK_HEADER || pos >= end) {
+        return false;
+    }
+
+    //Type and inflated size, the size continues in 7 bit groups
+    uchar c = bytes[pos++];
+    int objectType = (c >> 4) & 7;
+    qint64 size = c & 0x0F;
+    int shift = 4;
+    while(c & 0x80) {
+        if(pos >= end || shift > 56) {
+            return false;
+        }
+        c = bytes[pos++];
+        size |= qint64(c & 0x7F) << shift;
+        shift += 7;
+    }
+
+    int baseType = 0;
+    QByteArray base;
+    if(objectType == GIT_OBJ_OFS_DELTA) {
+        if(pos >= end) {
+            return false;
+        }
+        c = bytes[pos++];
+        qint64 distance = c & 0x7F;
+        while(c & 0x80) {
+            if(pos >= end || distance > (Q_INT64_C(1) << 48)) {
+                return false;
+            }
+            c = bytes[pos++];
+            distance = ((distance + 1) << 7) | (c & 0x7F);
+        }
+        if(distance <= 0 || distance > offset
+                || !readPacked(pack, offset - distance, &baseType, &base, depth + 1)) {
+            return false;
+        }
+    } else if(objectType == GIT_OBJ_REF_DELTA) {
+        if(pos + this->hashBytes > end) {
+            return false;
+        }
+        QByteArray baseHash(reinterpret_cast<const char*>(bytes + pos), this->hashBytes);
+        pos += this->hashBytes;
+        //Counts towards the same chain limit, a corrupt pack may refer to itself
+        if(!readObject(baseHash, &baseType, &base, depth + 1)) {
+            return false;
+        }
+    } else if(objectType < GIT_OBJ_COMMIT || objectType > GIT_OBJ_TAG) {
+        return false;
+    }
+
+    QByteArray inflated;
+    if(!inflateBytes(bytes + pos, end - pos, size, &inflated)) {
+        return false;
+    }
+    if(objectType == GIT_OBJ_OFS_DELTA || objectType == GIT_OBJ_REF_DELTA) {
+        if(!applyDelta(base, inflated, data)) {
+            return false;
+        }
+        *type = baseType;
+    } else {
+        *data = inflated;
+        *type = objectType;
+    }
+
+    CachedObject* object = new CachedObject;
+    object->type = *type;
+    object->data = *data;
+    this->cache.insert(key, object, qMax(data->size(), 1));
+
+    return true;
+}
+
+bool GitObjectStore::readLoose(const QByteArray &hash, int *type, QByteArray *data) const {
+    QString hex = QString::fromLatin1(hash.toHex());
+    QFile file(this->commonDir + "/objects/" + hex.left(2) + "/" + hex.mid(2));
+    QByteArray inflated;
+
+    if(!file.open(QIODevice::ReadOnly) || !inflateAll(file.readAll(), &inflated)) {
+        return false;
+    }
+
+    //"<type> <size>\0<content>"
+    int nul = inflated.indexOf('\0');
+    int space = inflated.indexOf(' ');
+    if(nul == -1 || space == -1 || space > nul) {
+        return false;
+    }
+    QByteArray typeName = inflated.left(space);
+    if(typeName == "commit") {
+        *type = GIT_OBJ_COMMIT;
+    } else if(typeName == "tree") {
+        *type = GIT_OBJ_TREE;
+    } else if(typeName == "blob") {
+        *type = GIT_OBJ_BLOB;
+    } else if(typeName == "tag") {
+        *type = GIT_OBJ_TAG;
+    } else {
+        return false;
+    }
+    *data = inflated.mid(nul + 1);
+
+    return data->size() == inflated.mid(space + 1, nul - space - 1).toInt();
+}
@@ -0,0 +1,102 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef GITOBJECTS_H
+#define GITOBJECTS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QFile>
+#include <QCache>
+
+#define GIT_OBJ_COMMIT      1
+#define GIT_OBJ_TREE        2
+#define GIT_OBJ_BLOB        3
+#define GIT_OBJ_TAG         4
+#define GIT_OBJ_OFS_DELTA   6
+#define GIT_OBJ_REF_DELTA   7
+
+#define GIT_OBJECT_CACHE    (64 * 1024 * 1024)
+
+struct GitTreeEntry {
+    QString name;
+    quint32 mode;
+    QByteArray hash;
+};
+
+struct GitCommit {
+    QByteArray tree;
+    QList<QByteArray> parents;
+    qint64 time;
+    QString subject;
+};
+
+/*
+ * Read only access to the object database of a git repository, loose objects
+ * as well as pack files (index version 2) with offset and reference deltas.
+ * Hashes are passed around in binary form. Inflated objects are kept in a
+ * cache bounded by GIT_OBJECT_CACHE bytes, which mostly serves delta bases
+ * shared by neighbouring objects.
+ */
+class GitObjectStore {
+public:
+    GitObjectStore();
+    ~GitObjectStore();
+
+    bool open(const QString& gitDir, QString* error);
+    int hashSize() const;
+
+    QByteArray resolve(const QString& ref) const;
+    bool read(const QByteArray& hash, int* type, QByteArray* data);
+    bool readCommit(const QByteArray& hash, GitCommit* commit);
+    bool readTree(const QByteArray& hash, QList<GitTreeEntry>* entries);
+
+private:
+    struct Pack {
+        QFile* index;
+        QFile* data;
+        const uchar* indexMap;
+        const uchar* dataMap;
+        qint64 dataSize;
+        quint32 count;
+    };
+
+    struct CachedObject {
+        int type;
+        QByteArray data;
+    };
+
+    Q_DISABLE_COPY(GitObjectStore)
+
+    bool openPack(const QString& indexFile);
+    qint64 findPacked(const Pack& pack, const QByteArray& hash) const;
+    bool readObject(const QByteArray& hash, int* type, QByteArray* data, int depth);
+    bool readPacked(int pack, qint64 offset, int* type, QByteArray* data, int depth);
+    bool readLoose(const QByteArray& hash, int* type, QByteArray* data) const;
+
+    QString gitDir;
+    QString commonDir;
+    int hashBytes;
+    QVector<Pack> packs;
+    QCache<quint64, CachedObject> cache;
+};
+
+#endif // GITOBJECTS_H
@@ -21,20 +21,37 @@
 #include <QCoreApplication>
 
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QDir>
 #include <QString>
 #include <QTextStream>
-#include <QMultiMap>
+#include <QMap>
+#include <QSet>
+#include <QHash>
+#include <QVector>
 #include <QDebug>
 
 #include <iostream>
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
 
 #include "configdto.h"
+#include "pathtrie.h"
+#include "filereader.h"
+#include "fileidentity.h"
+#include "gitindex.h"
+#include "gitobjects.h"
+#include "scancache.h"
+#include "edgestore.h"
+#include "partialgraph.h"
+#include "svglayout.h"
 
 #define GOLDEN_SECTION  137.50309
 
+#define HISTORY_TOP_HEADERS 3
+
 #define VERSION "v0.9.1"
 
 void printHelp() {
@@ -97,11 +114,78 @@ void printHelp() {
     err << "--config            Provide a config file which contains the options for\n";
     err << "                    dep-analyser. Command line options override settings\n";
     err << "                    in the configuration file.\n";
-    err << "                    NOTE: Not yet functional!";
+    err << "                    NOTE: Not yet functional!\n";
+    err << "--git-index         List the files to scan from the index of the git\n";
+    err << "                    repository containing the source directory instead of\n";
+    err << "                    walking the directory tree. Only tracked files are\n";
+    err << "                    scanned.\n";
+    err << "--untracked         Only with \"--git-index\". Also scan untracked files,\n";
+    err << "                    found by walking the directory tree.\n";
+    err << "--cache             Followed by a file to keep scan results in. Files which\n";
+    err << "                    did not change since the last run are not read again.\n";
+    err << "                    With \"--git-index\" the hashes in the index are used\n";
+    err << "                    for files whose stat data still matches the index, like\n";
+    err << "                    \"git status\" does, other files are judged by stat data.\n";
+    err << "--impacted-by       Followed by a comma separated list of changed files or\n";
+    err << "                    \"-\" to read them from stdin, one per line. Relative\n";
+    err << "                    paths are taken from the top of the git work tree\n";
+    err << "                    containing the current directory, as printed by \"git\n";
+    err << "                    diff --name-only\", or from the current directory\n";
+    err << "                    outside of a repository. Prints the translation units\n";
+    err << "                    including a changed file directly or indirectly\n";
+    err << "                    instead of a graph. With \"--merge\" the modules or\n";
+    err << "                    directories of these are printed. Uses the scan cache\n";
+    err << "                    without rescanning if \"--cache\" is given.\n";
+    err << "--show-depth        Only with \"--impacted-by\". Prefix every result with\n";
+    err << "                    the shortest include distance to a changed file.\n";
+    err << "--io-depth          Number of file reads kept in flight while scanning.\n";
+    err << "                    Uses io_uring where available. Default: 64.\n";
+    err << "--memory-limit      Followed by a memory budget in MB for the edges of the\n";
+    err << "                    graph. Edges beyond the budget are spilled to sorted\n";
+    err << "                    files in the temporary directory and merged from\n";
+    err << "                    there. The output does not change. Outside of the\n";
+    err << "                    budget remain the file names, a few bytes per node,\n";
+    err << "                    the \"--cache\" contents, the \"--color-nodes\" counts\n";
+    err << "                    and the \"--format svg\" layout.\n";
+    err << "--shard             Followed by i/N. Scans only the files of the i-th of N\n";
+    err << "                    shards of the source directories and writes a partial\n";
+    err << "                    graph to stdout instead of a diagram. Directories are\n";
+    err << "                    assigned to shards by a hash of their path relative to\n";
+    err << "                    \"--src\", every directory belongs to exactly one shard.\n";
+    err << "                    Every shard needs its own \"--cache\" file.\n";
+    err << "--merge-shards      Followed by a comma separated list of partial graphs\n";
+    err << "                    written by \"--shard\". Combines all N shards instead of\n";
+    err << "                    scanning, all other options apply as usual. The shards\n";
+    err << "                    have to be scanned with the same options from the same\n";
+    err << "                    checkout path.\n";
+    err << "--history           Followed by a number of commits. Reads the first parent\n";
+    err << "                    history of HEAD from the object store of the git\n";
+    err << "                    repository containing the source directory, without\n";
+    err << "                    checking anything out, and prints one line per commit,\n";
+    err << "                    oldest first: hash, date, nodes, edges, include cycles\n";
+    err << "                    and the most directly included nodes. \"--merge\"\n";
+    err << "                    applies. Headers outside the repository are looked up\n";
+    err << "                    as they are on disk now.\n";
+    err << "--history-graphs    Only with \"--history\". Followed by a comma separated\n";
+    err << "                    list of commit hashes or hash prefixes. The graph of\n";
+    err << "                    each matching commit is written to <hash>.dot, or\n";
+    err << "                    <hash>.svg with \"--format svg\", in the current\n";
+    err << "                    directory.\n";
+    err << "--format            Output format:\n";
+    err << "                        dot - the default, graphviz input\n";
+    err << "                        svg - laid out by dep-analyser itself, meant for\n";
+    err << "                              graphs too large for graphviz. \"--groups\"\n";
+    err << "                              clusters are not drawn.\n";
     err << "\n";
     err << "Usage:\n";
     err << "    dep-analyser > deps.dot\n";
     err << "    dot -Tpng deps.dot -o deps.png\n";
+    err << "    dep-analyser --format svg > deps.svg\n";
+    err << "    git diff --name-only | dep-analyser --cache deps.cache --impacted-by -\n";
+    err << "    dep-analyser --shard 0/2 > 0.part\n";
+    err << "    dep-analyser --shard 1/2 > 1.part\n";
+    err << "    dep-analyser --merge-shards 0.part,1.part > deps.dot\n";
+    err << "    dep-analyser --history 1000 --history-graphs 1a2b3c4d > history.tsv\n";
     err.flush();
     exit(0);
 }
@@ -115,12 +199,36 @@ void printConfig(const ConfigDTO& config, QTextStream& err) {
         case MERGE_MODULE: err << "module\n"; break;
         case MERGE_DIR: err << "directory\n"; break;
     }
+    err << "Output format: " << (config.outputFormat == FORMAT_SVG ? "svg" : "dot") << "\n";
     err << "Quote types: ";
     switch(config.quoteType) {
         case QUOTE_BOTH: err << "both\n"; break;
         case QUOTE_ANGLE: err << "angle\n"; break;
         case QUOTE_QUOTE: err << "quote\n"; break;
     }
+    err << "I/O depth: " << config.ioDepth << "\n";
+    if(config.memoryLimit > 0) {
+        err << "Memory limit: " << config.memoryLimit << " MB\n";
+    }
+    if(config.shardCount > 0) {
+        err << "Shard: " << config.shardIndex << "/" << config.shardCount << "\n";
+    }
+    if(!config.shardFiles.isEmpty()) {
+        err << "Merge shards: " << config.shardFiles.join(", ") << "\n";
+    }
+    if(config.historyCount > 0) {
+        err << "History commits: " << config.historyCount << "\n";
+        if(!config.historyGraphs.isEmpty()) {
+            err << "History graphs: " << config.historyGraphs.join(", ") << "\n";
+        }
+    }
+    err << "Use git index: " << (config.gitIndex ? "yes" : "no") << "\n";
+    if(config.gitIndex) {
+        err << "Scan untracked files: " << (config.untracked ? "yes" : "no") << "\n";
+    }
+    if(!config.cacheFile.isEmpty()) {
+        err << "Scan cache: " << config.cacheFile << "\n";
+    }
     err << "Create groups: " << (config.groups ? "yes" : "no") << "\n";
     err << "Ignore missing includes: " << (config.ignoreMissing ? "yes" : "no") << "\n";
     err << "Colorize graph: " << (config.colorize ? "yes" : "no") << "\n";
@@ -140,10 +248,42 @@ void printConfig(const ConfigDTO& config, QTextStream& err) {
     err.flush();
 }
 
-void parseDir(const ConfigDTO& config, QMultiMap<QString, QString>& mapping,
-              const QList<QDir>& includeDirs, const QString& path, QTextStream& err) {
+QStringList sourceFilter() {
+    QStringList filter;
+    filter << "*.c" << "*.cc" << "*.cpp" << "*.cxx" << "*.h" << "*.hpp" << "*.hxx";
+
+    return filter;
+}
+
+bool inShard(const ConfigDTO& config, const QString& relativeDir) {
+    if(config.shardCount == 0) {
+        return true;
+    }
+
+    //FNV-1a, stable across runs, processes and machines
+    QByteArray bytes = relativeDir.toUtf8();
+    quint32 hash = 2166136261u;
+    for(int i = 0; i < bytes.size(); i++) {
+        hash ^= quint8(bytes.at(i));
+        hash *= 16777619u;
+    }
+
+    return int(hash % quint32(config.shardCount)) == config.shardIndex;
+}
+
+void parseDir(const ConfigDTO& config, FileIdentity& identity, QStringList& files,
+              QList<FileStamp>& stamps, const QString& path, QTextStream& err) {
     QDir current(path);
 
+    //Symlinked directories are only scanned once, this also breaks symlink loops
+    if(!identity.visitDirectory(path)) {
+        if(config.debug) {
+            err << "Skipping already visited directory " << path << "\n";
+            err.flush();
+        }
+        return;
+    }
+
     if(config.debug) {
         err << "parse directory " << path << "\n";
         err.flush();
@@ -152,89 +292,411 @@ void parseDir(const ConfigDTO& config, QMultiMap<QString, QString>& mapping,
     //Get subdirectories
     QStringList subDirs = current.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
     foreach(const QString& subDir, subDirs) {
-        parseDir(config, mapping, includeDirs, current.absoluteFilePath(subDir), err);
+        parseDir(config, identity, files, stamps, current.absoluteFilePath(subDir), err);
+    }
+
+    //Every shard walks all directories but only takes the files of its own
+    QString relativeDir = path.mid(config.srcPath.length());
+    while(relativeDir.startsWith('/')) {
+        relativeDir.remove(0, 1);
+    }
+    if(!inShard(config, relativeDir)) {
+        if(config.debug) {
+            err << "Directory " << path << " belongs to another shard\n";
+            err.flush();
+        }
+        return;
     }
 
     //GetFiles
-    QStringList filter;
-    filter << "*.c" << "*.cc" << "*.cpp" << "*.cxx" << "*.h" << "*.hpp" << "*.hxx";
-    QStringList files = current.entryList(filter, QDir::Files | QDir::NoDotAndDotDot
-                                          | QDir::Readable);
+    QStringList entries = current.entryList(sourceFilter(), QDir::Files
+                                            | QDir::NoDotAndDotDot | QDir::Readable);
+    QRegExp exclude(config.excludeRegEx);
 
-    foreach(const QString& file, files) {
+    foreach(const QString& file, entries) {
         QString absolutePath = current.absoluteFilePath(file);
-        QRegExp exclude(config.excludeRegEx);
-        QRegExp excludeIncl(config.excludeIncludeRegEx);
         if(config.excludeRegEx.isEmpty() || exclude.indexIn(absolutePath) == -1) {
+            //Stamps and aliases are left to identifyFiles
+            files << absolutePath;
+            stamps << FileStamp();
+        } else if(config.debug) {
+            err << "Excluding file " << absolutePath << "\n";
+            err.flush();
+        }
+    }
+}
+
+/*
+ * Whether the stat data in the git index still describes the file in the work
+ * tree, the check git itself does before trusting the hash of an entry.
+ */
+bool indexStampValid(const FileStamp& index, const FileStamp& disk) {
+    const qint64 second = 1000000000;
+
+    if(index.mtime / second != disk.mtime / second) {
+        return false;
+    }
+    //Nanoseconds are only stored by some git builds
+    if(index.mtime % second != 0 && index.mtime != disk.mtime) {
+        return false;
+    }
+
+    //The index keeps the lower 32 bits of the size only
+    return index.size == (disk.size & Q_INT64_C(0xFFFFFFFF));
+}
+
+bool parseGitIndex(const ConfigDTO& config, FileIdentity& identity, QStringList& files,
+                   QList<FileStamp>& stamps, QTextStream& err) {
+    QString workTree;
+    QString gitDir = GitIndex::findGitDir(config.srcPath, &workTree);
+    GitIndex index;
+    QString error;
+
+    if(gitDir.isEmpty()) {
+        err << "No git repository found for " << config.srcPath << "\n";
+        err.flush();
+        return false;
+    }
+    if(!index.read(gitDir + "/index", GitIndex::hashSize(gitDir), &error)) {
+        err << error << "\n";
+        err.flush();
+        return false;
+    }
+
+    const qint64 second = 1000000000;
+    FileStamp indexStamp;
+    FileIdentity::identify(gitDir + "/index", 0, &indexStamp);
+
+    QDir root(workTree);
+    QString prefix = root.relativeFilePath(config.srcPath);
+    QStringList filter = sourceFilter();
+    QRegExp exclude(config.excludeRegEx);
+    QSet<QString> tracked;
+
+    if(prefix.compare(".") == 0) {
+        prefix.clear();
+    }
+    if(!prefix.isEmpty()) {
+        prefix += '/';
+    }
+
+    //Files are enumerated from the index, identifyFiles stats the work tree
+    foreach(const GitIndexEntry& entry, index.entries()) {
+        quint32 type = entry.mode & GIT_MODE_TYPE_MASK;
+        if((type != GIT_MODE_FILE && type != GIT_MODE_SYMLINK)
+                || !entry.path.startsWith(prefix)
+                || !QDir::match(filter, entry.path.section('/', -1))) {
+            continue;
+        }
+
+        QString absolutePath = root.absoluteFilePath(entry.path);
+        if(tracked.contains(absolutePath)) {
+            continue;
+        }
+        tracked.insert(absolutePath);
+        int slash = entry.path.lastIndexOf('/');
+        if(!inShard(config, slash < prefix.length() ? QString()
+                    : entry.path.mid(prefix.length(), slash - prefix.length()))) {
+            continue;
+        }
+        if(!config.excludeRegEx.isEmpty() && exclude.indexIn(absolutePath) != -1) {
+            if(config.debug) {
+                err << "Excluding file " << absolutePath << "\n";
+                err.flush();
+            }
+            continue;
+        }
+
+        files << absolutePath;
+        //The index describes a symlink itself, not the file it points to. Entries
+        //not older than the index file are racy, they may have been changed again
+        //within the same second.
+        if(type == GIT_MODE_FILE && entry.stamp.mtime / second < indexStamp.mtime / second) {
+            stamps << entry.stamp;
+        } else {
+            stamps << FileStamp();
+        }
+    }
+
+    if(config.debug) {
+        err << "Read " << index.entries().count() << " entries from " << gitDir
+            << "/index\n";
+        err.flush();
+    }
+
+    if(config.untracked) {
+        QStringList walked;
+        QList<FileStamp> walkedStamps;
+        parseDir(config, identity, walked, walkedStamps, config.srcPath, err);
+        for(int i = 0; i < walked.count(); i++) {
+            if(!tracked.contains(walked.at(i))) {
+                files << walked.at(i);
+                stamps << walkedStamps.at(i);
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Stats the enumerated files in one batch on the reader and keeps the first
+ * path reaching every physical file, later paths are aliases of it. This runs
+ * before any include is resolved, so includes reaching a scanned file through
+ * another path end up at the node of the scanned path. A stamp taken from the
+ * git index replaces the stat stamp while it still describes the file.
+ */
+void identifyFiles(const ConfigDTO& config, FileReader& reader, PathTrie& paths,
+                   FileIdentity& identity, QStringList& files, QList<FileStamp>& stamps,
+                   QTextStream& err) {
+    QVector<FileStat> stats;
+    QStringList known;
+    QList<FileStamp> knownStamps;
+
+    reader.statFiles(files, stats);
+
+    for(int i = 0; i < files.count(); i++) {
+        const QString& file = files.at(i);
+        const FileStat& stat = stats.at(i);
+
+        if(!stat.exists) {
             if(config.debug) {
-                err << "Analyse file " << absolutePath << "\n";
+                err << "Skipping missing file " << file << "\n";
                 err.flush();
             }
-            QFile currentFile(absolutePath);
-            bool open = currentFile.open(QIODevice::ReadOnly | QIODevice::Text);
-            if(!open) {
-                err << "Could not read " << absolutePath << "\n";
+            continue;
+        }
+        if(identity.isKnown(stat.id)) {
+            if(config.debug) {
+                err << "Skipping alias " << file << "\n";
                 err.flush();
+            }
+            continue;
+        }
+        identity.canonical(stat.id, paths.insert(file));
+
+        if(config.debug) {
+            err << "Analyse file " << file << "\n";
+            err.flush();
+        }
+        known << file;
+        if(stamps.at(i).size >= 0 && indexStampValid(stamps.at(i), stat.stamp)) {
+            knownStamps << stamps.at(i);
+        } else {
+            knownStamps << stat.stamp;
+        }
+    }
+
+    files = known;
+    stamps = knownStamps;
+}
+
+QStringList extractIncludes(const ConfigDTO& config, const QByteArray& contents) {
+    QStringList includes;
+    QRegExp sep("[>\"]");
+    int start = 0;
+
+    while(start < contents.size()) {
+        int end = contents.indexOf('\n', start);
+        end = (end == -1) ? contents.size() : end + 1;
+
+        //Only lines starting with an include are converted to a string
+        if(end - start > 9 && qstrncmp(contents.constData() + start, "#include ", 9) == 0) {
+            QString line = QString::fromUtf8(contents.constData() + start + 9, end - start - 9);
+            line.remove('\r');
+            if(!(line.startsWith("<") && config.quoteType == QUOTE_QUOTE)
+                    && !(line.startsWith("\"") && config.quoteType == QUOTE_ANGLE)) {
+                line = line.right(line.length() - 1);
+                includes << line.section(sep, 0, 0);
+            }
+        }
+
+        start = end;
+    }
+
+    return includes;
+}
+
+void resolveIncludes(const ConfigDTO& config, EdgeStore& mapping, PathTrie& paths,
+                     FileIdentity& identity, const QList<QDir>& includeDirs,
+                     const QString& absolutePath, const QStringList& includes,
+                     QStringList* targets, QTextStream& err) {
+    QDir current = QFileInfo(absolutePath).absoluteDir();
+    QRegExp excludeIncl(config.excludeIncludeRegEx);
+    PathId source = paths.insert(absolutePath);
+
+    foreach(const QString& line, includes) {
+        bool exists = false;
+        FileId id;
+        QString includePath = line;
+
+        if(config.excludeIncludeRegEx.isEmpty() || excludeIncl.indexIn(includePath) == -1) {
+            //Check if file exists
+            QString candidate = current.absoluteFilePath(line);
+            if(FileIdentity::identify(candidate, &id)) {
+                exists = true;
+                includePath = candidate;
             } else {
-                while(!currentFile.atEnd()) {
-                    QString line = currentFile.readLine();
-                    if(line.startsWith("#include ")) {
-                        line = line.right(line.length() - 9);
-                        if(!(line.startsWith("<") && config.quoteType == QUOTE_QUOTE)
-                                && !(line.startsWith("\"")
-                                     && config.quoteType == QUOTE_ANGLE)) {
-                            QRegExp sep("[>\"]");
-                            bool exists = false;
-                            line = line.right(line.length() - 1);
-                            line = line.section(sep, 0, 0);
-                            QString includePath = line;
-
-                            if(config.excludeIncludeRegEx.isEmpty()
-                                    || excludeIncl.indexIn(includePath) == -1) {
-                                //Check if file exists
-                                if(QFile::exists(current.absoluteFilePath(line))) {
-                                    exists = true;
-                                    includePath = current.absoluteFilePath(line);
-                                } else {
-                                    for(int i = 0; i < includeDirs.count() && !exists;
-                                        i++) {
-                                        if(QFile::exists(includeDirs.at(i).
-                                                         absoluteFilePath(line))) {
-                                            exists = true;
-                                            includePath = includeDirs.at(i).
-                                                    absoluteFilePath(line);
-                                        }
-                                    }
-                                }
-
-                                if(config.ignoreMissing) {
-                                    exists = true;
-                                }
-
-                                if(exists) {
-                                    mapping.insert(absolutePath, includePath);
-                                } else {
-                                    err << "Could not find include " << includePath
-                                        << " from " << absolutePath << "\n";
-                                    err.flush();
-                                }
-                            } else if(config.debug) {
-                                err << "Ignoring include " << includePath << "\n";
-                                err.flush();
-                            }
-                        }
+                for(int i = 0; i < includeDirs.count() && !exists; i++) {
+                    candidate = includeDirs.at(i).absoluteFilePath(line);
+                    if(FileIdentity::identify(candidate, &id)) {
+                        exists = true;
+                        includePath = candidate;
                     }
                 }
             }
+
+            if(config.ignoreMissing) {
+                exists = true;
+            }
+
+            if(exists) {
+                //Every path reaching the same file ends up at the same node
+                PathId target = identity.canonical(id, paths.insert(includePath));
+                mapping.insert(source, target);
+                if(targets) {
+                    *targets << paths.path(target);
+                }
+            } else {
+                err << "Could not find include " << includePath
+                    << " from " << absolutePath << "\n";
+                err.flush();
+            }
         } else if(config.debug) {
-            err << "Excluding file " << absolutePath << "\n";
+            err << "Ignoring include " << includePath << "\n";
             err.flush();
         }
     }
 }
 
-QMultiMap<QString, QString> parseSource(const ConfigDTO& config, QTextStream& err) {
-    QMultiMap<QString, QString> result;
+/*
+ * Reads and parses the enumerated files. Files whose stamp matches the scan
+ * cache are not read, their include directives are taken from the cache and
+ * resolved again. Reads complete in any order, early arrivals are held back
+ * so the files are always parsed in the order of the file list and the graph
+ * does not depend on I/O timing. The reader bounds how far it runs ahead, see
+ * FileReader.
+ */
+class IncludeScanner : public FileConsumer {
+public:
+    IncludeScanner(const ConfigDTO& config, EdgeStore& mapping, PathTrie& paths,
+                   FileIdentity& identity, const QList<QDir>& includeDirs,
+                   QTextStream& err)
+        : config(config), mapping(mapping), paths(paths), identity(identity),
+          includeDirs(includeDirs), err(err) {
+        this->nextIndex = 0;
+        this->cache = 0;
+        this->updated = 0;
+    }
+
+    void scan(FileReader& reader, const QStringList& files, const QList<FileStamp>& stamps,
+              const ScanCache& cache, ScanCache& updated) {
+        QStringList toRead;
+
+        this->files = files;
+        this->stamps = stamps;
+        this->cache = &cache;
+        this->updated = &updated;
+        this->cached.fill(false, files.count());
+        this->readIndex.clear();
+        this->nextIndex = 0;
+
+        for(int i = 0; i < files.count(); i++) {
+            if(cache.contains(files.at(i))) {
+                this->cached[i] = cache.entry(files.at(i)).stamp == stamps.at(i);
+            }
+            if(!this->cached.at(i)) {
+                toRead << files.at(i);
+                this->readIndex << i;
+            }
+        }
+
+        if(this->config.debug) {
+            this->err << files.count() - toRead.count() << " of " << files.count()
+                      << " files unchanged since the last run\n";
+            this->err << "Reading " << toRead.count() << " files using " << reader.name()
+                      << "\n";
+            this->err.flush();
+        }
+
+        this->parsePending();
+        reader.readFiles(toRead, *this);
+        this->parsePending();
+    }
+
+    void fileRead(int index, const QByteArray& contents) {
+        this->done.insert(this->readIndex.at(index), contents);
+        this->parsePending();
+    }
+
+    void fileFailed(int index) {
+        this->done.insert(this->readIndex.at(index), QByteArray());
+        this->failed.insert(this->readIndex.at(index));
+        this->parsePending();
+    }
+
+private:
+    void parsePending() {
+        bool keep = !this->config.cacheFile.isEmpty();
+
+        while(this->nextIndex < this->files.count()) {
+            int index = this->nextIndex;
+            const QString& file = this->files.at(index);
+            CacheEntry entry;
+
+            if(this->cached.at(index)) {
+                //Where an include resolves to also depends on files outside of
+                //the scanned set, only the directives are reused
+                entry = this->cache->entry(file);
+                entry.targets.clear();
+                resolveIncludes(this->config, this->mapping, this->paths, this->identity,
+                                this->includeDirs, file, entry.includes,
+                                keep ? &entry.targets : 0, this->err);
+            } else if(this->done.contains(index)) {
+                QByteArray contents = this->done.take(index);
+                if(this->failed.remove(index)) {
+                    this->err << "Could not read " << file << "\n";
+                    this->err.flush();
+                    this->nextIndex++;
+                    continue;
+                }
+                entry.stamp = this->stamps.at(index);
+                entry.includes = extractIncludes(this->config, contents);
+                resolveIncludes(this->config, this->mapping, this->paths, this->identity,
+                                this->includeDirs, file, entry.includes,
+                                keep ? &entry.targets : 0, this->err);
+            } else {
+                break;
+            }
+
+            if(keep) {
+                this->updated->insert(file, entry);
+            }
+            this->nextIndex++;
+        }
+    }
+
+    const ConfigDTO& config;
+    EdgeStore& mapping;
+    PathTrie& paths;
+    FileIdentity& identity;
+    const QList<QDir>& includeDirs;
+    QTextStream& err;
+
+    QStringList files;
+    QList<FileStamp> stamps;
+    const ScanCache* cache;
+    ScanCache* updated;
+    QVector<bool> cached;
+    QVector<int> readIndex;
+
+    int nextIndex;
+    QHash<int, QByteArray> done;
+    QSet<int> failed;
+};
+
+void parseSource(const ConfigDTO& config, PathTrie& paths, FileIdentity& identity,
+                 EdgeStore& result, QTextStream& err) {
     QList<QDir> includeDirs;
 
     //Create include dirs
@@ -252,58 +714,137 @@ QMultiMap<QString, QString> parseSource(const ConfigDTO& config, QTextStream& er
         err.flush();
     }
 
-    parseDir(config, result, includeDirs, config.srcPath, err);
+    //The walk only lists paths, the stat calls run batched on the reader
+    QStringList files;
+    QList<FileStamp> stamps;
+    if(!config.gitIndex || !parseGitIndex(config, identity, files, stamps, err)) {
+        parseDir(config, identity, files, stamps, config.srcPath, err);
+    }
+    FileReader* reader = FileReader::create(config.ioDepth);
+    identifyFiles(config, *reader, paths, identity, files, stamps, err);
+
+    ScanCache cache;
+    ScanCache updated;
+    QString fingerprint = ScanCache::fingerprint(config);
+    if(!config.cacheFile.isEmpty() && !cache.load(config.cacheFile, fingerprint)
+            && config.debug) {
+        err << "No usable scan cache in " << config.cacheFile << "\n";
+        err.flush();
+    }
 
-    return result;
+    IncludeScanner scanner(config, result, paths, identity, includeDirs, err);
+    scanner.scan(*reader, files, stamps, cache, updated);
+    result.finish();
+    delete reader;
+
+    if(!config.cacheFile.isEmpty()) {
+        foreach(const FileId& id, identity.knownFiles()) {
+            updated.insertCanonical(id, paths.path(identity.find(id)));
+        }
+    }
+
+    if(!config.cacheFile.isEmpty() && !updated.save(config.cacheFile, fingerprint)) {
+        err << "Could not write scan cache " << config.cacheFile << "\n";
+        err.flush();
+    }
 }
 
-QMultiMap<QString, QString> mergeModules(QMultiMap<QString, QString> mapping) {
-    QMultiMap<QString, QString> result;
-
-    QMapIterator<QString, QString> iterator(mapping);
-    while(iterator.hasNext()) {
-        iterator.next();
-        QString key = iterator.key().section('.', 0, -2);
-        QString value = iterator.value().section('/', 0, -2,
-                                                 QString::SectionIncludeTrailingSep);
-        QString file = iterator.value().section('/', -1, -1);
-        if(file.contains('.')) {
-            file = file.section('.', 0, -2);
-        }
-        value += file;
-        if(key.compare(value) != 0 && !result.values(key).contains(value)) {
+void mergeModules(const EdgeStore& mapping, PathTrie& paths, EdgeStore& result) {
+    EdgeReader reader(mapping);
+    Edge edge;
+
+    while(reader.next(&edge)) {
+        PathId key = paths.stem(edge.from);
+        PathId value = paths.stem(edge.to);
+        if(key != value) {
             result.insert(key, value);
         }
     }
 
-    return result;
+    result.finish();
 }
 
-QMultiMap<QString, QString> mergeDirectories(QMultiMap<QString, QString> mapping) {
-    QMultiMap<QString, QString> result;
+void mergeDirectories(const EdgeStore& mapping, const PathTrie& paths, EdgeStore& result) {
+    EdgeReader reader(mapping);
+    Edge edge;
 
-    QMapIterator<QString, QString> iterator(mapping);
-    while(iterator.hasNext()) {
-        iterator.next();
-        QString key = iterator.key().section('/', 0, -2);
-        QString value = iterator.value().section('/', 0, -2);
-        if(key.compare(value) != 0 && !result.values(key).contains(value)) {
+    while(reader.next(&edge)) {
+        PathId key = paths.parent(edge.from);
+        PathId value = paths.parent(edge.to);
+        if(key != value) {
             result.insert(key, value);
         }
     }
 
-    return result;
+    result.finish();
 }
 
-QString removeBaseDir(QString path, const QString& baseDir) {
-    if(path.startsWith(baseDir)) {
-        path = path.remove(baseDir.section('/', 0, -2));
-        if(path.startsWith("/")) {
-            path = path.right(path.length() - 1);
+const EdgeStore& mergeGraph(const ConfigDTO& config, PathTrie& paths, EdgeStore& mapping,
+                            EdgeStore& merged) {
+    if(config.mergeMode == MERGE_FILE) {
+        return mapping;
+    }
+
+    if(config.mergeMode == MERGE_MODULE) {
+        mergeModules(mapping, paths, merged);
+    } else {
+        mergeDirectories(mapping, paths, merged);
+    }
+    mapping.clear();
+
+    return merged;
+}
+
+/*
+ * Labels of the nodes in the dot and SVG output. While the edges are held in
+ * memory every label is built once and kept per node. For spilled edges they
+ * are built on every use, a string per node would not count against
+ * --memory-limit.
+ */
+class NodeLabels {
+public:
+    NodeLabels(const PathTrie& paths, bool fileOnly, bool cached)
+        : paths(paths), fileOnly(fileOnly) {
+        if(cached) {
+            this->labels.resize(paths.count());
         }
     }
 
-    return path;
+    QString label(PathId id) {
+        if(this->labels.isEmpty()) {
+            return build(id);
+        }
+
+        QString& label = this->labels[id];
+        if(label.isNull()) {
+            label = build(id);
+        }
+        return label;
+    }
+
+private:
+    QString build(PathId id) const {
+        return this->fileOnly ? this->paths.name(id) : this->paths.relativePath(id);
+    }
+
+    const PathTrie& paths;
+    bool fileOnly;
+    QVector<QString> labels;
+};
+
+/*
+ * Reports the failure of a store, a run that could not be written, merged or
+ * read back. finish() and every reader of the store record it there, so it
+ * is checked once after the store was built and once after it was read.
+ */
+bool edgesFailed(const EdgeStore& edges, QTextStream& err) {
+    if(edges.errorString().isEmpty()) {
+        return false;
+    }
+
+    err << edges.errorString() << "\n";
+    err.flush();
+    return true;
 }
 
 QString nextColor(int saturation, int value) {
@@ -370,16 +911,77 @@ QString nextColor(int saturation, int value) {
         }
     }
 
-    return QString("#%1%2%3").arg(QString::number(r, 16)).
-            arg(QString::number(g, 16)).arg(QString::number(b, 16));
+    return QString("#%1%2%3").arg(r, 2, 16, QChar('0')).
+            arg(g, 2, 16, QChar('0')).arg(b, 2, 16, QChar('0'));
 }
 
-void printMapping(const QMultiMap<QString, QString>& mapping, QTextStream& out,
-                  const ConfigDTO& config) {
-    QStringList keys = mapping.keys();
-    QString baseDir = config.srcPath;
+void closeEdgeList(QTextStream& out, const ConfigDTO& config) {
+    out << "}";
+
+    if(config.colorize) {
+        out << " [color=\"" << nextColor(config.saturation, config.value) << "\"]";
+    }
+
+    out << "\n";
+}
+
+class PathOrder {
+public:
+    PathOrder(const PathTrie& paths) : paths(paths) {}
+
+    bool operator()(PathId a, PathId b) const {
+        return this->paths.lessThan(a, b);
+    }
+
+private:
+    const PathTrie& paths;
+};
+
+/*
+ * Copies the edges with both ends replaced by their rank in path order, so the
+ * copy lists sources and targets sorted by path like the map the graph was
+ * kept in before. nodes receives the node of every rank.
+ */
+void sortByPath(const EdgeStore& mapping, const PathTrie& paths, EdgeStore& sorted,
+                QVector<PathId>& nodes) {
+    QVector<int> rank(paths.count(), -1);
+    EdgeReader reader(mapping);
+    Edge edge;
+
+    while(reader.next(&edge)) {
+        if(rank.at(edge.from) == -1) {
+            rank[edge.from] = 0;
+            nodes << edge.from;
+        }
+        if(rank.at(edge.to) == -1) {
+            rank[edge.to] = 0;
+            nodes << edge.to;
+        }
+    }
+
+    std::sort(nodes.begin(), nodes.end(), PathOrder(paths));
+    for(int i = 0; i < nodes.count(); i++) {
+        rank[nodes.at(i)] = i;
+    }
+
+    EdgeReader ranked(mapping);
+    while(ranked.next(&edge)) {
+        sorted.insert(rank.at(edge.from), rank.at(edge.to));
+    }
+    sorted.finish();
+}
+
+bool printMapping(const EdgeStore& mapping, const PathTrie& paths, QTextStream& out,
+                  const ConfigDTO& config, QTextStream& err) {
     bool group = config.groups && config.mergeMode != MERGE_DIR;
-    keys.removeDuplicates();
+    bool fileOnly = group && !config.keepPaths;
+
+    //Edges by rank, nodes maps a rank back to its node
+    EdgeStore sorted(qint64(config.memoryLimit) << 20);
+    QVector<PathId> nodes;
+    sortByPath(mapping, paths, sorted, nodes);
+    NodeLabels labels(paths, fileOnly, !mapping.isSpilled());
+    NodeLabels dirLabels(paths, false, !mapping.isSpilled());
 
     //Write header
     out << "digraph \"source tree\" {\n";
@@ -391,30 +993,21 @@ void printMapping(const QMultiMap<QString, QString>& mapping, QTextStream& out,
 
     if(config.colorNodes) {
         QMap<QString, int> allObjects;
-        foreach(const QString& key, keys) {
-            QString name = removeBaseDir(key, baseDir);
-
-            if (group && !config.keepPaths) {
-                name = name.section('/', -1, -1);
-            }
-
-            if (!allObjects.contains(name)) {
-                allObjects.insert(name, 0);
-            }
-            QStringList values = mapping.values(key);
-
-            foreach(const QString& value, values) {
-                name = removeBaseDir(value, baseDir);
-                if (group && !config.keepPaths) {
-                    name = name.section('/', -1, -1);
-                }
+        EdgeReader reader(sorted);
+        Edge edge;
+        int key = -1;
+        while(reader.next(&edge)) {
+            if(edge.from != key) {
+                key = edge.from;
+                QString name = labels.label(nodes.at(key));
 
-                if (allObjects.contains(name)) {
-                    allObjects.insert(name, allObjects.value(name, 0) + 1);
-                } else {
-                    allObjects.insert(name, 1);
+                if (!allObjects.contains(name)) {
+                    allObjects.insert(name, 0);
                 }
             }
+
+            QString include = labels.label(nodes.at(edge.to));
+            allObjects.insert(include, allObjects.value(include, 0) + 1);
         }
 
         QMap<QString, int>::iterator it = allObjects.begin();
@@ -428,63 +1021,822 @@ void printMapping(const QMultiMap<QString, QString>& mapping, QTextStream& out,
     }
 
     if(group) {
-        QStringList allNodes = keys;
-        allNodes << mapping.values();
-        allNodes.removeDuplicates();
-        foreach(const QString& key, allNodes) {
-            QString dir = key;
-            QString file = key;
-            QString escDir;
-            dir = removeBaseDir(dir.section('/', 0, -2), baseDir);
-            if(config.keepPaths) {
-                file = removeBaseDir(file, baseDir);
-            } else {
-                file = file.section('/', -1, -1);
+        //Sources first, then the remaining targets, each sorted by path
+        QList<int> allNodes;
+        QVector<bool> seen(nodes.count(), false);
+        EdgeReader reader(sorted);
+        Edge edge;
+        while(reader.next(&edge)) {
+            if(!seen.at(edge.from)) {
+                seen[edge.from] = true;
+                allNodes << edge.from;
+            }
+        }
+        EdgeReader values(sorted);
+        while(values.next(&edge)) {
+            if(!seen.at(edge.to)) {
+                seen[edge.to] = true;
+                allNodes << edge.to;
             }
-            escDir = dir;
+        }
+        foreach(int rank, allNodes) {
+            PathId key = nodes.at(rank);
+            QString dir = dirLabels.label(paths.parent(key));
+            QString escDir = dir;
             escDir = escDir.replace('/', "_");
 
             out << "subgraph \"cluster_" << escDir << "\" {\n";
             out << "    label=\"" << dir << "\"\n";
-            out << "    \"" << file << "\"\n";
+            out << "    \"" << labels.label(key) << "\"\n";
             out << "}\n";
         }
     }
 
-    foreach(const QString& key, keys) {
-        QStringList values = mapping.values(key);
-        QString name = removeBaseDir(key, baseDir);
-        if(group && !config.keepPaths) {
-            name = name.section('/', -1);
+    //Edges arrive grouped by their source, one line per source
+    EdgeReader reader(sorted);
+    Edge edge;
+    int key = -1;
+    while(reader.next(&edge)) {
+        if(edge.from != key) {
+            if(key != -1) {
+                closeEdgeList(out, config);
+            }
+            key = edge.from;
+            out << "    \"" << labels.label(nodes.at(key)) << "\" -> { ";
         }
-        out << "    \"" << name << "\" -> { ";
 
-        foreach(const QString& value, values) {
-            QString include = removeBaseDir(value, baseDir);
-            if(group && !config.keepPaths) {
-                include = include.section('/', -1);
+        out << "\"" << labels.label(nodes.at(edge.to)) << "\" ";
+    }
+    if(key != -1) {
+        closeEdgeList(out, config);
+    }
+
+    out << "}\n";
+    out.flush();
+
+    return !edgesFailed(sorted, err) && !edgesFailed(mapping, err);
+}
+
+int svgNode(SvgLayout& layout, QHash<QString, int>& nodeIndex, QVector<int>& dependencies,
+            const QString& label) {
+    int node = nodeIndex.value(label, -1);
+    if(node == -1) {
+        node = layout.addNode(label);
+        nodeIndex.insert(label, node);
+        dependencies.append(0);
+    }
+
+    return node;
+}
+
+bool printSvg(const EdgeStore& mapping, const PathTrie& paths, QTextStream& out,
+              const ConfigDTO& config, QTextStream& err) {
+    bool fileOnly = config.groups && config.mergeMode != MERGE_DIR && !config.keepPaths;
+    NodeLabels labels(paths, fileOnly, !mapping.isSpilled());
+    QHash<QString, int> nodeIndex;
+    QVector<int> dependencies;
+    SvgLayout layout;
+
+    //Same nodes and colors as the dot output, one color per source node
+    EdgeReader reader(mapping);
+    Edge edge;
+    PathId key = PATH_NONE;
+    int from = -1;
+    QString color = "black";
+    while(reader.next(&edge)) {
+        if(edge.from != key) {
+            key = edge.from;
+            from = svgNode(layout, nodeIndex, dependencies,
+                           labels.label(key));
+            if(config.colorize) {
+                color = nextColor(config.saturation, config.value);
             }
-            out << "\"" << include << "\" ";
         }
 
-        out << "}";
+        int to = svgNode(layout, nodeIndex, dependencies,
+                         labels.label(edge.to));
+        dependencies[to]++;
+        layout.addEdge(from, to, color);
+    }
 
-        if(config.colorize) {
-            out << " [color=\"" << nextColor(config.saturation, config.value) << "\"]";
+    if(config.colorNodes) {
+        for(int i = 0; i < dependencies.count(); i++) {
+            layout.setNodeColor(i, config.getNodeColor(dependencies.at(i)));
         }
+    }
 
-        out << "\n";
+    if(edgesFailed(mapping, err)) {
+        return false;
     }
 
-    out << "}\n";
+    layout.layout();
+    layout.write(out);
+
+    return true;
+}
+
+bool loadCachedGraph(const ConfigDTO& config, PathTrie& paths, FileIdentity& identity,
+                     EdgeStore& mapping, QTextStream& err) {
+    ScanCache cache;
+
+    if(!cache.load(config.cacheFile, ScanCache::fingerprint(config))) {
+        return false;
+    }
+
+    QList<QString> files = cache.paths();
+    foreach(const QString& file, files) {
+        PathId source = paths.insert(file);
+        foreach(const QString& target, cache.entry(file).targets) {
+            mapping.insert(source, paths.insert(target));
+        }
+    }
+    mapping.finish();
+
+    QHash<FileId, QString>::const_iterator it = cache.canonicalPaths().constBegin();
+    while(it != cache.canonicalPaths().constEnd()) {
+        identity.canonical(it.key(), paths.insert(it.value()));
+        it++;
+    }
+
+    if(config.debug) {
+        err << "Loaded " << files.count() << " files from scan cache " << config.cacheFile
+            << "\n";
+        err.flush();
+    }
+
+    return true;
+}
+
+QStringList readChangedFiles(const QString& list) {
+    QStringList changed;
+
+    if(list.compare("-") == 0) {
+        QTextStream in(stdin);
+        QString line = in.readLine();
+        while(!line.isNull()) {
+            line = line.trimmed();
+            if(!line.isEmpty()) {
+                changed << line;
+            }
+            line = in.readLine();
+        }
+    } else {
+        changed = list.split(",", QString::SkipEmptyParts);
+    }
+
+    //git diff prints paths relative to the top of the work tree
+    QString workTree;
+    QDir base = QDir::current();
+    if(!GitIndex::findGitDir(QDir::currentPath(), &workTree).isEmpty()) {
+        base = QDir(workTree);
+    }
+    for(int i = 0; i < changed.count(); i++) {
+        changed[i] = QDir::cleanPath(base.absoluteFilePath(changed.at(i)));
+    }
+
+    return changed;
+}
+
+bool isTranslationUnit(const QString& file) {
+    return file.endsWith(".c") || file.endsWith(".cc") || file.endsWith(".cpp")
+            || file.endsWith(".cxx");
+}
+
+void printImpacted(const EdgeStore& mapping, PathTrie& paths, const FileIdentity& identity,
+                   const QStringList& changed, QTextStream& out, const ConfigDTO& config,
+                   QTextStream& err) {
+    QVector<int> depth(paths.count(), -1);
+    bool grown = false;
+
+    foreach(const QString& file, changed) {
+        //The scan may have reached the file through another path, deleted
+        //files can only be found by their path
+        FileId fileId;
+        PathId id = PATH_NONE;
+        if(FileIdentity::identify(file, &fileId)) {
+            id = identity.find(fileId);
+        }
+        if(id == PATH_NONE) {
+            id = paths.find(file);
+        }
+        if(id == PATH_NONE) {
+            err << file << " is not part of the dependency graph\n";
+            err.flush();
+        } else {
+            depth[id] = 0;
+            grown = true;
+        }
+    }
+
+    if(mapping.isSpilled()) {
+        //Breadth first search over the reversed edges with one pass over the
+        //edge stream per level, only the depth of every node is kept in memory
+        for(int level = 0; grown; level++) {
+            EdgeReader reader(mapping);
+            Edge edge;
+            grown = false;
+            while(reader.next(&edge)) {
+                if(depth.at(edge.to) == level && depth.at(edge.from) == -1) {
+                    depth[edge.from] = level + 1;
+                    grown = true;
+                }
+            }
+        }
+    } else {
+        //Reverse adjacency in compressed row form, from a file to its includers.
+        //It is as large as the edges, which are in memory anyway.
+        int count = paths.count();
+        QVector<int> start(count + 1, 0);
+        QVector<PathId> includers(int(mapping.count()));
+        EdgeReader counter(mapping);
+        Edge edge;
+        while(counter.next(&edge)) {
+            start[edge.to + 1]++;
+        }
+        for(int i = 0; i < count; i++) {
+            start[i + 1] += start.at(i);
+        }
+        QVector<int> fill = start;
+        EdgeReader reader(mapping);
+        while(reader.next(&edge)) {
+            includers[fill[edge.to]++] = edge.from;
+        }
+
+        //One breadth first search starting from all changed files at once
+        QVector<PathId> queue;
+        for(PathId id = 0; id < count; id++) {
+            if(depth.at(id) == 0) {
+                queue << id;
+            }
+        }
+        for(int i = 0; i < queue.count(); i++) {
+            PathId id = queue.at(i);
+            for(int j = start.at(id); j < start.at(id + 1); j++) {
+                PathId includer = includers.at(j);
+                if(depth.at(includer) == -1) {
+                    depth[includer] = depth.at(id) + 1;
+                    queue << includer;
+                }
+            }
+        }
+    }
+
+    //Report the translation units, or the modules or directories containing them
+    QMap<QString, int> impacted;
+    for(PathId id = 0; id < depth.count(); id++) {
+        if(depth.at(id) == -1 || !isTranslationUnit(paths.name(id))) {
+            continue;
+        }
+        PathId reported = id;
+        if(config.mergeMode == MERGE_MODULE) {
+            reported = paths.stem(id);
+        } else if(config.mergeMode == MERGE_DIR) {
+            reported = paths.parent(id);
+        }
+        QString name = paths.path(reported);
+        if(!impacted.contains(name) || depth.at(id) < impacted.value(name)) {
+            impacted.insert(name, depth.at(id));
+        }
+    }
+
+    QMapIterator<QString, int> it(impacted);
+    while(it.hasNext()) {
+        it.next();
+        if(config.showDepth) {
+            out << it.value() << "\t";
+        }
+        out << it.key() << "\n";
+    }
     out.flush();
 }
 
+/*
+ * Include graph along the first parent history of HEAD, read from the git
+ * object store without checking anything out. Includes are extracted once
+ * per blob hash. Moving to the next commit only compares the trees, skipping
+ * subtrees whose hash did not change, and resolves again the files which
+ * changed or whose includes name a file that appeared or vanished.
+ */
+class HistoryScanner {
+public:
+    HistoryScanner(const ConfigDTO& config, GitObjectStore& store, PathTrie& paths,
+                   const QString& workTree, QTextStream& err)
+        : config(config), store(store), paths(paths), workTree(workTree), err(err),
+          exclude(config.excludeRegEx), excludeIncl(config.excludeIncludeRegEx) {
+        this->includeDirs << QDir(config.srcPath);
+        foreach(const QString& inclDir, config.includePaths) {
+            this->includeDirs << QDir(inclDir);
+        }
+        this->filter = sourceFilter();
+    }
+
+    bool checkout(const QByteArray& tree) {
+        if(!diffTree(this->tree, tree, this->workTree)) {
+            return false;
+        }
+        this->tree = tree;
+
+        if(this->config.debug) {
+            this->err << "Resolving " << this->dirty.count() << " files\n";
+            this->err.flush();
+        }
+        foreach(PathId file, this->dirty) {
+            resolve(file);
+        }
+        this->dirty.clear();
+
+        return true;
+    }
+
+    void graph(EdgeStore& edges) const {
+        QHash<PathId, QVector<PathId> >::const_iterator it = this->targets.constBegin();
+        while(it != this->targets.constEnd()) {
+            foreach(PathId target, it.value()) {
+                edges.insert(it.key(), target);
+            }
+            it++;
+        }
+        edges.finish();
+    }
+
+    int parsedBlobs() const {
+        return this->includeCache.count();
+    }
+
+private:
+    bool diffTree(const QByteArray& oldTree, const QByteArray& newTree, const QString& dir) {
+        QList<GitTreeEntry> oldEntries;
+        QList<GitTreeEntry> newEntries;
+
+        if(oldTree == newTree) {
+            return true;
+        }
+        if((!oldTree.isEmpty() && !this->store.readTree(oldTree, &oldEntries))
+                || (!newTree.isEmpty() && !this->store.readTree(newTree, &newEntries))) {
+            this->err << "Could not read the tree of " << dir << "\n";
+            this->err.flush();
+            return false;
+        }
+
+        QHash<QString, int> previous;
+        for(int i = 0; i < oldEntries.count(); i++) {
+            previous.insert(oldEntries.at(i).name, i);
+        }
+
+        bool ok = true;
+        foreach(const GitTreeEntry& entry, newEntries) {
+            QString path = dir + "/" + entry.name;
+            bool isTree = (entry.mode & GIT_MODE_TYPE_MASK) == GIT_MODE_TREE;
+            QByteArray before;
+
+            QHash<QString, int>::iterator found = previous.find(entry.name);
+            if(found != previous.end()) {
+                const GitTreeEntry& old = oldEntries.at(found.value());
+                previous.erase(found);
+                if(old.hash == entry.hash && old.mode == entry.mode) {
+                    continue;
+                }
+                bool wasTree = (old.mode & GIT_MODE_TYPE_MASK) == GIT_MODE_TREE;
+                if(wasTree == isTree) {
+                    before = old.hash;
+                } else if(wasTree) {
+                    ok = ok && diffTree(old.hash, QByteArray(), path);
+                } else {
+                    removeFile(path);
+                }
+            }
+
+            if(isTree) {
+                ok = ok && diffTree(before, entry.hash, path);
+            } else {
+                addFile(path, entry);
+            }
+        }
+
+        QHash<QString, int>::const_iterator it = previous.constBegin();
+        while(it != previous.constEnd()) {
+            const GitTreeEntry& old = oldEntries.at(it.value());
+            QString path = dir + "/" + old.name;
+            if((old.mode & GIT_MODE_TYPE_MASK) == GIT_MODE_TREE) {
+                ok = ok && diffTree(old.hash, QByteArray(), path);
+            } else {
+                removeFile(path);
+            }
+            it++;
+        }
+
+        return ok;
+    }
+
+    void addFile(const QString& path, const GitTreeEntry& entry) {
+        quint32 type = entry.mode & GIT_MODE_TYPE_MASK;
+        if(type != GIT_MODE_FILE && type != GIT_MODE_SYMLINK) {
+            return;
+        }
+
+        PathId id = this->paths.insert(path);
+        bool added = !this->files.contains(id);
+        this->files.insert(id, entry.hash);
+
+        //Symlinks only count as existing, their blob is the link target
+        if(type == GIT_MODE_FILE && isSource(path)) {
+            this->sources.insert(id);
+            this->dirty.insert(id);
+        } else if(this->sources.remove(id)) {
+            dropSource(id);
+        }
+        if(added) {
+            touchName(this->paths.name(id));
+        }
+    }
+
+    void removeFile(const QString& path) {
+        PathId id = this->paths.find(path);
+        if(id == PATH_NONE || this->files.remove(id) == 0) {
+            return;
+        }
+
+        if(this->sources.remove(id)) {
+            dropSource(id);
+        }
+        touchName(this->paths.name(id));
+    }
+
+    void dropSource(PathId id) {
+        this->targets.remove(id);
+        this->dirty.remove(id);
+        foreach(const QString& name, this->names.take(id)) {
+            this->includers[name].remove(id);
+        }
+    }
+
+    void touchName(const QString& name) {
+        //Includes naming this file may resolve to another file now
+        QHash<QString, QSet<PathId> >::const_iterator it = this->includers.constFind(name);
+        if(it != this->includers.constEnd()) {
+            this->dirty.unite(it.value());
+        }
+    }
+
+    bool isSource(const QString& path) const {
+        return path.startsWith(this->config.srcPath + "/")
+                && QDir::match(this->filter, path.section('/', -1))
+                && (this->config.excludeRegEx.isEmpty() || this->exclude.indexIn(path) == -1);
+    }
+
+    bool exists(const QString& path) {
+        if(path.startsWith(this->workTree + "/")) {
+            PathId id = this->paths.find(path);
+            return id != PATH_NONE && this->files.contains(id);
+        }
+
+        //Outside of the repository, e.g. system headers, as they are now
+        QHash<QString, bool>::const_iterator it = this->external.constFind(path);
+        if(it != this->external.constEnd()) {
+            return it.value();
+        }
+        bool found = QFileInfo(path).isFile();
+        this->external.insert(path, found);
+
+        return found;
+    }
+
+    void resolve(PathId file) {
+        QByteArray blob = this->files.value(file);
+        QStringList includes;
+
+        QHash<QByteArray, QStringList>::const_iterator cached = this->includeCache.constFind(blob);
+        if(cached != this->includeCache.constEnd()) {
+            includes = cached.value();
+        } else {
+            int type;
+            QByteArray contents;
+            if(this->store.read(blob, &type, &contents) && type == GIT_OBJ_BLOB) {
+                includes = extractIncludes(this->config, contents);
+            } else {
+                this->err << "Could not read blob " << blob.toHex() << " of "
+                          << this->paths.path(file) << "\n";
+                this->err.flush();
+            }
+            this->includeCache.insert(blob, includes);
+        }
+
+        foreach(const QString& name, this->names.take(file)) {
+            this->includers[name].remove(file);
+        }
+
+        //Same lookup order as resolveIncludes, against the files of the tree
+        QDir current(this->paths.path(this->paths.parent(file)));
+        QStringList fileNames;
+        QVector<PathId> resolved;
+        foreach(const QString& line, includes) {
+            QString name = line.section('/', -1);
+            fileNames << name;
+            this->includers[name].insert(file);
+
+            if(!this->config.excludeIncludeRegEx.isEmpty()
+                    && this->excludeIncl.indexIn(line) != -1) {
+                continue;
+            }
+
+            PathId target = PATH_NONE;
+            QString candidate = QDir::cleanPath(current.absoluteFilePath(line));
+            if(exists(candidate)) {
+                target = this->paths.insert(candidate);
+            }
+            for(int i = 0; i < this->includeDirs.count() && target == PATH_NONE; i++) {
+                candidate = QDir::cleanPath(this->includeDirs.at(i).absoluteFilePath(line));
+                if(exists(candidate)) {
+                    target = this->paths.insert(candidate);
+                }
+            }
+            if(target == PATH_NONE && this->config.ignoreMissing) {
+                target = this->paths.insert(line);
+            }
+
+            if(target != PATH_NONE) {
+                resolved << target;
+            } else if(this->config.debug) {
+                this->err << "Could not find include " << line << " from "
+                          << this->paths.path(file) << "\n";
+                this->err.flush();
+            }
+        }
+        this->names.insert(file, fileNames);
+        this->targets.insert(file, resolved);
+    }
+
+    const ConfigDTO& config;
+    GitObjectStore& store;
+    PathTrie& paths;
+    QString workTree;
+    QTextStream& err;
+    QList<QDir> includeDirs;
+    QStringList filter;
+    QRegExp exclude;
+    QRegExp excludeIncl;
+
+    QByteArray tree;
+    QHash<PathId, QByteArray> files;
+    QSet<PathId> sources;
+    QSet<PathId> dirty;
+    QHash<QByteArray, QStringList> includeCache;
+    QHash<PathId, QVector<PathId> > targets;
+    QHash<PathId, QStringList> names;
+    QHash<QString, QSet<PathId> > includers;
+    QHash<QString, bool> external;
+};
+
+struct GraphMetrics {
+    int nodes;
+    qint64 edges;
+    int cycles;
+    QList<PathId> heaviest;
+    QList<int> includers;
+};
+
+/*
+ * Node and edge count, the number of include cycles, counted as strongly
+ * connected components with more than one node or a self include, and the
+ * nodes included by the most other nodes.
+ */
+void graphMetrics(const EdgeStore& mapping, const PathTrie& paths, GraphMetrics* metrics) {
+    int count = paths.count();
+    QVector<int> start(count + 1, 0);
+    QVector<PathId> adjacent(int(mapping.count()));
+    QVector<int> inDegree(count, 0);
+    QVector<bool> present(count, false);
+    QVector<bool> selfLoop(count, false);
+
+    EdgeReader counter(mapping);
+    Edge edge;
+    while(counter.next(&edge)) {
+        start[edge.from + 1]++;
+        inDegree[edge.to]++;
+        present[edge.from] = true;
+        present[edge.to] = true;
+        if(edge.from == edge.to) {
+            selfLoop[edge.from] = true;
+        }
+    }
+    for(int i = 0; i < count; i++) {
+        start[i + 1] += start.at(i);
+    }
+    //Edges arrive sorted by source, so they fill the rows in order
+    EdgeReader reader(mapping);
+    int next = 0;
+    while(reader.next(&edge)) {
+        adjacent[next++] = edge.to;
+    }
+
+    metrics->nodes = 0;
+    metrics->edges = mapping.count();
+    metrics->cycles = 0;
+    metrics->heaviest.clear();
+    metrics->includers.clear();
+
+    //Tarjan's algorithm with an explicit stack
+    QVector<int> index(count, -1);
+    QVector<int> low(count, 0);
+    QVector<bool> onStack(count, false);
+    QVector<PathId> stack;
+    QVector<PathId> callNodes;
+    QVector<int> callEdges;
+    int counterIndex = 0;
+    for(PathId root = 0; root < count; root++) {
+        if(!present.at(root)) {
+            continue;
+        }
+        metrics->nodes++;
+        if(index.at(root) != -1) {
+            continue;
+        }
+
+        index[root] = low[root] = counterIndex++;
+        stack << root;
+        onStack[root] = true;
+        callNodes << root;
+        callEdges << start.at(root);
+        while(!callNodes.isEmpty()) {
+            PathId node = callNodes.last();
+            if(callEdges.last() < start.at(node + 1)) {
+                PathId target = adjacent.at(callEdges.last());
+                callEdges.last()++;
+                if(index.at(target) == -1) {
+                    index[target] = low[target] = counterIndex++;
+                    stack << target;
+                    onStack[target] = true;
+                    callNodes << target;
+                    callEdges << start.at(target);
+                } else if(onStack.at(target)) {
+                    low[node] = qMin(low.at(node), index.at(target));
+                }
+                continue;
+            }
+
+            callNodes.removeLast();
+            callEdges.removeLast();
+            if(!callNodes.isEmpty()) {
+                low[callNodes.last()] = qMin(low.at(callNodes.last()), low.at(node));
+            }
+            if(low.at(node) == index.at(node)) {
+                int size = 0;
+                PathId member;
+                do {
+                    member = stack.last();
+                    stack.removeLast();
+                    onStack[member] = false;
+                    size++;
+                } while(member != node);
+                if(size > 1 || selfLoop.at(node)) {
+                    metrics->cycles++;
+                }
+            }
+        }
+    }
+
+    //Most included first, ties broken by path
+    for(PathId id = 0; id < count; id++) {
+        if(inDegree.at(id) == 0) {
+            continue;
+        }
+        int pos = metrics->heaviest.count();
+        while(pos > 0 && (inDegree.at(id) > metrics->includers.at(pos - 1)
+                          || (inDegree.at(id) == metrics->includers.at(pos - 1)
+                              && paths.relativePath(id)
+                                 < paths.relativePath(metrics->heaviest.at(pos - 1))))) {
+            pos--;
+        }
+        if(pos < HISTORY_TOP_HEADERS) {
+            metrics->heaviest.insert(pos, id);
+            metrics->includers.insert(pos, inDegree.at(id));
+            if(metrics->heaviest.count() > HISTORY_TOP_HEADERS) {
+                metrics->heaviest.removeLast();
+                metrics->includers.removeLast();
+            }
+        }
+    }
+}
+
+int printHistory(const ConfigDTO& config, QTextStream& out, QTextStream& err) {
+    QString workTree;
+    QString gitDir = GitIndex::findGitDir(config.srcPath, &workTree);
+    GitObjectStore store;
+    QString error;
+
+    if(gitDir.isEmpty()) {
+        err << "No git repository found for " << config.srcPath << "\n";
+        err.flush();
+        return 1;
+    }
+    if(!store.open(gitDir, &error)) {
+        err << error << "\n";
+        err.flush();
+        return 1;
+    }
+
+    //Walk the first parent line back from HEAD, then replay it oldest first
+    QList<QByteArray> hashes;
+    QList<GitCommit> commits;
+    QByteArray hash = store.resolve("HEAD");
+    while(!hash.isEmpty() && hashes.count() < config.historyCount) {
+        GitCommit commit;
+        if(!store.readCommit(hash, &commit)) {
+            err << "Could not read commit " << hash.toHex() << "\n";
+            err.flush();
+            return 1;
+        }
+        hashes.prepend(hash);
+        commits.prepend(commit);
+        hash = commit.parents.isEmpty() ? QByteArray() : commit.parents.first();
+    }
+    if(hashes.isEmpty()) {
+        err << "HEAD of " << gitDir << " does not point to a commit\n";
+        err.flush();
+        return 1;
+    }
+
+    PathTrie paths(config.srcPath);
+    HistoryScanner scanner(config, store, paths, workTree, err);
+    qint64 memoryLimit = qint64(config.memoryLimit) << 20;
+    QSet<QString> matched;
+
+    out << "commit\tdate\tnodes\tedges\tcycles\theaviest\n";
+    for(int i = 0; i < hashes.count(); i++) {
+        const GitCommit& commit = commits.at(i);
+        QString hex = QString::fromLatin1(hashes.at(i).toHex());
+
+        if(config.debug) {
+            err << "Commit " << hex << " " << commit.subject << "\n";
+            err.flush();
+        }
+        if(!scanner.checkout(commit.tree)) {
+            return 1;
+        }
+
+        EdgeStore mapping(memoryLimit);
+        EdgeStore merged(memoryLimit);
+        scanner.graph(mapping);
+        const EdgeStore& graph = mergeGraph(config, paths, mapping, merged);
+
+        GraphMetrics metrics;
+        graphMetrics(graph, paths, &metrics);
+        if(edgesFailed(mapping, err) || edgesFailed(merged, err)) {
+            return 1;
+        }
+        out << hex << "\t"
+            << QDateTime::fromMSecsSinceEpoch(commit.time * 1000).toUTC().toString(Qt::ISODate)
+            << "\t" << metrics.nodes << "\t" << metrics.edges << "\t" << metrics.cycles << "\t";
+        for(int j = 0; j < metrics.heaviest.count(); j++) {
+            out << (j > 0 ? ", " : "") << paths.relativePath(metrics.heaviest.at(j)) << " ("
+                << metrics.includers.at(j) << ")";
+        }
+        out << "\n";
+        out.flush();
+
+        foreach(const QString& prefix, config.historyGraphs) {
+            if(!hex.startsWith(prefix.toLower())) {
+                continue;
+            }
+            matched.insert(prefix);
+
+            QFile graphFile(hex + (config.outputFormat == FORMAT_SVG ? ".svg" : ".dot"));
+            if(!graphFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+                err << "Could not write " << graphFile.fileName() << "\n";
+                err.flush();
+                continue;
+            }
+            QTextStream graphOut(&graphFile);
+            bool written;
+            if(config.outputFormat == FORMAT_SVG) {
+                written = printSvg(graph, paths, graphOut, config, err);
+            } else {
+                written = printMapping(graph, paths, graphOut, config, err);
+            }
+            if(!written) {
+                return 1;
+            }
+        }
+    }
+
+    foreach(const QString& prefix, config.historyGraphs) {
+        if(!matched.contains(prefix)) {
+            err << "No commit matching " << prefix << " in the last " << hashes.count()
+                << " commits\n";
+        }
+    }
+    if(config.debug) {
+        err << "Extracted includes from " << scanner.parsedBlobs() << " blobs\n";
+    }
+    err.flush();
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     QTextStream out(stdout);
     QTextStream err(stderr);
     ConfigDTO config;
-    QMultiMap<QString, QString> mapping;
     bool hasConfigFile = false;
     QString configFile;
 
@@ -528,6 +1880,30 @@ int main(int argc, char *argv[]) {
             optCode = OPT_COLOR_NODES;
         } else if(opt.compare("--config") == 0) {
             optCode = OPT_CONFIG;
+        } else if(opt.compare("--format") == 0) {
+            optCode = OPT_FORMAT;
+        } else if(opt.compare("--io-depth") == 0) {
+            optCode = OPT_IO_DEPTH;
+        } else if(opt.compare("--git-index") == 0) {
+            optCode = OPT_GIT_INDEX;
+        } else if(opt.compare("--untracked") == 0) {
+            optCode = OPT_UNTRACKED;
+        } else if(opt.compare("--cache") == 0) {
+            optCode = OPT_CACHE;
+        } else if(opt.compare("--impacted-by") == 0) {
+            optCode = OPT_IMPACTED;
+        } else if(opt.compare("--show-depth") == 0) {
+            optCode = OPT_SHOW_DEPTH;
+        } else if(opt.compare("--memory-limit") == 0) {
+            optCode = OPT_MEMORY_LIMIT;
+        } else if(opt.compare("--shard") == 0) {
+            optCode = OPT_SHARD;
+        } else if(opt.compare("--merge-shards") == 0) {
+            optCode = OPT_MERGE_SHARDS;
+        } else if(opt.compare("--history") == 0) {
+            optCode = OPT_HISTORY;
+        } else if(opt.compare("--history-graphs") == 0) {
+            optCode = OPT_HISTORY_GRAPHS;
         } else {
             err << "Unknown argument " << opt << "\n";
             err.flush();
@@ -553,6 +1929,11 @@ int main(int argc, char *argv[]) {
             case OPT_IGNMIS: config.ignoreMissing = true; break;
             case OPT_COLOR: config.colorize = true; break;
             case OPT_KEEP: config.keepPaths = true; break;
+            case OPT_GIT_INDEX: config.gitIndex = true; break;
+            case OPT_UNTRACKED: config.untracked = true; break;
+            case OPT_CACHE: config.cacheFile = optValue; break;
+            case OPT_IMPACTED: config.impactedBy = optValue; break;
+            case OPT_SHOW_DEPTH: config.showDepth = true; break;
             case OPT_EXCLUDE: config.excludeRegEx = optValue; break;
             case OPT_EXCLINC: config.excludeIncludeRegEx = optValue; break;
             case OPT_SRC: {
@@ -636,6 +2017,63 @@ int main(int argc, char *argv[]) {
                 hasConfigFile = true;
                 configFile = optValue;
                 break;
+            case OPT_FORMAT:
+                config.cmdProvided |= PROV_FORMAT;
+                if(optValue.compare("dot") == 0) {
+                    config.outputFormat = FORMAT_DOT;
+                } else if(optValue.compare("svg") == 0) {
+                    config.outputFormat = FORMAT_SVG;
+                } else {
+                    err << "Unknown output format " << optValue << "\n";
+                    err.flush();
+                    printHelp();
+                }
+                break;
+            case OPT_IO_DEPTH:
+                config.ioDepth = optValue.toInt(&converted);
+                if(!converted || config.ioDepth < 1) {
+                    err << "Illegal value for io depth: " << optValue << "\n";
+                    err.flush();
+                    printHelp();
+                }
+                break;
+            case OPT_MEMORY_LIMIT:
+                config.memoryLimit = optValue.toInt(&converted);
+                if(!converted || config.memoryLimit < 1) {
+                    err << "Illegal value for memory limit: " << optValue << "\n";
+                    err.flush();
+                    printHelp();
+                }
+                break;
+            case OPT_SHARD: {
+                QStringList parts = optValue.split('/');
+                bool countConverted = false;
+                if(parts.count() == 2) {
+                    config.shardIndex = parts.at(0).toInt(&converted);
+                    config.shardCount = parts.at(1).toInt(&countConverted);
+                }
+                if(!converted || !countConverted || config.shardCount < 1
+                        || config.shardIndex < 0 || config.shardIndex >= config.shardCount) {
+                    err << "Illegal value for shard: " << optValue << "\n";
+                    err.flush();
+                    printHelp();
+                }
+                }
+                break;
+            case OPT_MERGE_SHARDS:
+                config.shardFiles << optValue.split(",", QString::SkipEmptyParts);
+                break;
+            case OPT_HISTORY:
+                config.historyCount = optValue.toInt(&converted);
+                if(!converted || config.historyCount < 1) {
+                    err << "Illegal value for history: " << optValue << "\n";
+                    err.flush();
+                    printHelp();
+                }
+                break;
+            case OPT_HISTORY_GRAPHS:
+                config.historyGraphs << optValue.split(",", QString::SkipEmptyParts);
+                break;
             default:
                 err << "Internal error... This should not have happended\n";
                 err.flush();
@@ -655,27 +2093,90 @@ int main(int argc, char *argv[]) {
         printConfig(config, err);
     }
 
-    mapping = parseSource(config, err);
+    if(config.historyCount > 0) {
+        return printHistory(config, out, err);
+    }
 
-    if(config.mergeMode == MERGE_MODULE) {
-        mapping = mergeModules(mapping);
-    } else if(config.mergeMode == MERGE_DIR) {
-        mapping = mergeDirectories(mapping);
+    if(config.shardCount > 0 && !config.shardFiles.isEmpty()) {
+        err << "--shard and --merge-shards can not be combined\n";
+        err.flush();
+        printHelp();
+    }
+    if(!config.shardFiles.isEmpty()) {
+        //Node labels are relative to the directory the shards were scanned in
+        QString srcPath = PartialGraph::sourcePath(config.shardFiles.first());
+        if(!srcPath.isEmpty()) {
+            config.srcPath = srcPath;
+        }
+    }
+
+    PathTrie paths(config.srcPath);
+    FileIdentity identity;
+    qint64 memoryLimit = qint64(config.memoryLimit) << 20;
+    EdgeStore mapping(memoryLimit);
+
+    if(!config.shardFiles.isEmpty()) {
+        QString error;
+        if(!PartialGraph::merge(config.shardFiles, paths, mapping, &error)) {
+            err << error << "\n";
+            err.flush();
+            return 1;
+        }
+    } else if(config.impactedBy.isEmpty() || config.cacheFile.isEmpty()
+              || !loadCachedGraph(config, paths, identity, mapping, err)) {
+        //Impact queries are answered from the scan cache if there is one
+        parseSource(config, paths, identity, mapping, err);
+    }
+    if(edgesFailed(mapping, err)) {
+        return 1;
+    }
+
+    if(config.shardCount > 0) {
+        QFile partial;
+        partial.open(stdout, QIODevice::WriteOnly);
+        if(!PartialGraph::write(&partial, config, paths, mapping)) {
+            if(!edgesFailed(mapping, err)) {
+                err << "Could not write the partial graph\n";
+                err.flush();
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+    if(!config.impactedBy.isEmpty()) {
+        QStringList changed = readChangedFiles(config.impactedBy);
+        printImpacted(mapping, paths, identity, changed, out, config, err);
+        return edgesFailed(mapping, err) ? 1 : 0;
+    }
+
+    EdgeStore merged(memoryLimit);
+    const EdgeStore& graph = mergeGraph(config, paths, mapping, merged);
+    if(edgesFailed(mapping, err) || edgesFailed(merged, err)) {
+        return 1;
     }
 
     if(config.debug) {
         //print the mapping
-        QStringList keys = mapping.keys();
-        keys.removeDuplicates();
-        foreach(const QString& key, keys) {
-            err << key << ":\n";
-            QStringList values = mapping.values(key);
-            foreach(const QString& value, values) {
-                err << "\t" << value << "\n";
+        EdgeReader reader(graph);
+        Edge edge;
+        PathId key = PATH_NONE;
+        while(reader.next(&edge)) {
+            if(edge.from != key) {
+                key = edge.from;
+                err << paths.path(key) << ":\n";
             }
+            err << "\t" << paths.path(edge.to) << "\n";
         }
         err.flush();
     }
 
-    printMapping(mapping, out, config);
+    bool written;
+    if(config.outputFormat == FORMAT_SVG) {
+        written = printSvg(graph, paths, out, config, err);
+    } else {
+        written = printMapping(graph, paths, out, config, err);
+    }
+
+    return written ? 0 : 1;
 }
@@ -0,0 +1,237 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "partialgraph.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QHash>
+#include <QVector>
+
+#include "scancache.h"
+
+struct ShardHeader {
+    QString file;
+    QString srcPath;
+    QString fingerprint;
+    qint32 shard;
+    qint32 shardCount;
+};
+
+static bool openShard(const QString& file, QFile& shardFile, QDataStream& in,
+                      ShardHeader* header) {
+    quint32 magic;
+    quint32 version;
+
+    shardFile.setFileName(file);
+    if(!shardFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    in.setDevice(&shardFile);
+    in.setVersion(QDataStream::Qt_4_8);
+    in >> magic >> version;
+    if(in.status() != QDataStream::Ok || magic != PARTIAL_MAGIC
+            || version != PARTIAL_VERSION) {
+        return false;
+    }
+    header->file = file;
+    in >> header->srcPath >> header->fingerprint >> header->shard >> header->shardCount;
+
+    return in.status() == QDataStream::Ok;
+}
+
+bool PartialGraph::write(QIODevice* device, const ConfigDTO& config, const PathTrie& paths,
+                         const EdgeStore& edges) {
+    QVector<qint32> local(paths.count(), -1);
+    QVector<PathId> nodes;
+    QVector<quint8> flags;
+    EdgeReader reader(edges);
+    Edge edge;
+
+    //Only nodes taking part in an edge are written, sources are scanned files
+    while(reader.next(&edge)) {
+        PathId ends[2] = { edge.from, edge.to };
+        for(int i = 0; i < 2; i++) {
+            if(local.at(ends[i]) == -1) {
+                local[ends[i]] = nodes.count();
+                nodes << ends[i];
+                flags << 0;
+            }
+        }
+        flags[local.at(edge.from)] |= PARTIAL_NODE_SCANNED;
+    }
+
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_4_8);
+    out << quint32(PARTIAL_MAGIC) << quint32(PARTIAL_VERSION) << config.srcPath
+        << ScanCache::fingerprint(config) << qint32(config.shardIndex)
+        << qint32(config.shardCount) << qint32(nodes.count());
+    for(int i = 0; i < nodes.count(); i++) {
+        //Unresolved includes kept by --ignoremissing stay keyed by their literal
+        //path, they must not be resolved against the working directory
+        QString path = paths.path(nodes.at(i));
+        QString realPath;
+        if(QDir::isAbsolutePath(path)) {
+            realPath = QFileInfo(path).canonicalFilePath();
+        }
+        out << path << realPath << flags.at(i);
+    }
+
+    out << edges.count();
+    EdgeReader localEdges(edges);
+    while(localEdges.next(&edge)) {
+        out << local.at(edge.from) << local.at(edge.to);
+    }
+
+    return out.status() == QDataStream::Ok && edges.errorString().isEmpty();
+}
+
+QString PartialGraph::sourcePath(const QString& file) {
+    QFile shardFile;
+    QDataStream in;
+    ShardHeader header;
+
+    if(!openShard(file, shardFile, in, &header)) {
+        return QString();
+    }
+
+    return header.srcPath;
+}
+
+bool PartialGraph::merge(const QStringList& files, PathTrie& paths, EdgeStore& edges,
+                         QString* error) {
+    QList<ShardHeader> headers;
+
+    //The files have to form one complete set of shards scanned alike
+    foreach(const QString& file, files) {
+        QFile shardFile;
+        QDataStream in;
+        ShardHeader header;
+        if(!openShard(file, shardFile, in, &header)) {
+            *error = file + " is not a partial graph of this version";
+            return false;
+        }
+        headers << header;
+    }
+    if(headers.isEmpty()) {
+        *error = "No partial graphs given";
+        return false;
+    }
+
+    const ShardHeader& first = headers.first();
+    if(first.shardCount != headers.count()) {
+        *error = QString("%1 partial graphs given, %2 was scanned as one of %3 shards")
+                .arg(headers.count()).arg(first.file).arg(first.shardCount);
+        return false;
+    }
+
+    QVector<QString> byShard(first.shardCount);
+    foreach(const ShardHeader& header, headers) {
+        if(header.fingerprint != first.fingerprint || header.shardCount != first.shardCount) {
+            *error = header.file + " was scanned with other options than " + first.file;
+            return false;
+        }
+        if(header.shard < 0 || header.shard >= header.shardCount) {
+            *error = header.file + " has an invalid shard number";
+            return false;
+        }
+        if(!byShard.at(header.shard).isEmpty()) {
+            *error = QString("Shard %1/%2 is given twice").arg(header.shard)
+                    .arg(header.shardCount);
+            return false;
+        }
+        byShard[header.shard] = header.file;
+    }
+
+    //Scanned files claim their resolved path first, in shard order, so an
+    //include through an alias ends up at the scanned file
+    QHash<QString, PathId> resolved;
+    foreach(const QString& file, byShard) {
+        QFile shardFile;
+        QDataStream in;
+        ShardHeader header;
+        qint32 nodeCount;
+        openShard(file, shardFile, in, &header);
+        in >> nodeCount;
+        for(qint32 i = 0; i < nodeCount && in.status() == QDataStream::Ok; i++) {
+            QString path;
+            QString realPath;
+            quint8 flags;
+            in >> path >> realPath >> flags;
+            if((flags & PARTIAL_NODE_SCANNED) && !realPath.isEmpty()
+                    && !resolved.contains(realPath)) {
+                resolved.insert(realPath, paths.insert(path));
+            }
+        }
+    }
+
+    //Every shard is read once more, mapping its node table onto the trie
+    foreach(const QString& file, byShard) {
+        QFile shardFile;
+        QDataStream in;
+        ShardHeader header;
+        qint32 nodeCount;
+        qint64 edgeCount;
+        openShard(file, shardFile, in, &header);
+        in >> nodeCount;
+
+        QVector<PathId> local(qMax(nodeCount, 0));
+        for(qint32 i = 0; i < nodeCount && in.status() == QDataStream::Ok; i++) {
+            QString path;
+            QString realPath;
+            quint8 flags;
+            in >> path >> realPath >> flags;
+            if(realPath.isEmpty()) {
+                local[i] = paths.insert(path);
+            } else {
+                local[i] = resolved.value(realPath, PATH_NONE);
+                if(local.at(i) == PATH_NONE) {
+                    local[i] = paths.insert(path);
+                    resolved.insert(realPath, local.at(i));
+                }
+            }
+        }
+
+        in >> edgeCount;
+        for(qint64 i = 0; i < edgeCount && in.status() == QDataStream::Ok; i++) {
+            qint32 from;
+            qint32 to;
+            in >> from >> to;
+            if(from < 0 || from >= nodeCount || to < 0 || to >= nodeCount) {
+                *error = file + " is corrupt";
+                return false;
+            }
+            edges.insert(local.at(from), local.at(to));
+        }
+
+        if(in.status() != QDataStream::Ok) {
+            *error = file + " is truncated";
+            return false;
+        }
+    }
+
+    if(!edges.finish()) {
+        *error = edges.errorString();
+        return false;
+    }
+
+    return true;
+}
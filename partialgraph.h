@@ -0,0 +1,54 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef PARTIALGRAPH_H
+#define PARTIALGRAPH_H
+
+#include <QString>
+#include <QStringList>
+#include <QIODevice>
+
+#include "configdto.h"
+#include "pathtrie.h"
+#include "edgestore.h"
+
+#define PARTIAL_MAGIC       0x44455053
+#define PARTIAL_VERSION     1
+
+#define PARTIAL_NODE_SCANNED 0x01
+
+/*
+ * Result of one shard of a sharded scan. The file holds the nodes referenced
+ * by the edges of the shard, each with its path and, for existing absolute
+ * paths, the path it resolves to on disk, followed by the edges as indices
+ * into that node table. Aliases of
+ * the same file are reconciled by the resolved path when the shards are
+ * merged, so the result does not depend on which shard saw an alias first.
+ */
+class PartialGraph {
+public:
+    static bool write(QIODevice* device, const ConfigDTO& config, const PathTrie& paths,
+                      const EdgeStore& edges);
+
+    static QString sourcePath(const QString& file);
+    static bool merge(const QStringList& files, PathTrie& paths, EdgeStore& edges,
+                      QString* error);
+};
+
+#endif // PARTIALGRAPH_H
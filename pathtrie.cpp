@@ -0,0 +1,263 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "pathtrie.h"
+
+#include <QVarLengthArray>
+
+PathTrie::PathTrie(const QString &baseDir) {
+    this->nodeCount = 0;
+    this->names.append(QString());
+    this->nameIndex.insert(QString(), 0);
+
+    //Two roots, one for absolute paths and one for unresolved relative includes
+    this->blocks.append(new Node[PATH_BLOCK_SIZE]);
+    for(int i = 0; i < 2; i++) {
+        Node& root = node(this->nodeCount);
+        root.parent = PATH_NONE;
+        root.name = 0;
+        root.stem = this->nodeCount;
+        root.belowBase = false;
+        this->nodeCount++;
+    }
+    this->absRoot = 0;
+    this->relRoot = 1;
+
+    this->base = insert(baseDir);
+    node(this->base).belowBase = true;
+}
+
+PathTrie::~PathTrie() {
+    qDeleteAll(this->blocks);
+}
+
+PathId PathTrie::insert(const QString &path) {
+    PathId current = path.startsWith('/') ? this->absRoot : this->relRoot;
+    int start = 0;
+
+    while(start < path.length()) {
+        int end = path.indexOf('/', start);
+        if(end == -1) {
+            end = path.length();
+        }
+        if(end > start) {
+            QString segment = path.mid(start, end - start);
+            if(segment.compare("..") == 0 && current != this->relRoot
+                    && this->names.at(node(current).name).compare("..") != 0) {
+                if(current != this->absRoot) {
+                    current = node(current).parent;
+                }
+            } else if(segment.compare(".") != 0) {
+                current = child(current, segment);
+            }
+        }
+        start = end + 1;
+    }
+
+    return current;
+}
+
+PathId PathTrie::find(const QString &path) const {
+    PathId current = path.startsWith('/') ? this->absRoot : this->relRoot;
+    int start = 0;
+
+    while(start < path.length() && current != PATH_NONE) {
+        int end = path.indexOf('/', start);
+        if(end == -1) {
+            end = path.length();
+        }
+        if(end > start) {
+            QString segment = path.mid(start, end - start);
+            if(segment.compare("..") == 0 && current != this->relRoot
+                    && this->names.at(node(current).name).compare("..") != 0) {
+                if(current != this->absRoot) {
+                    current = node(current).parent;
+                }
+            } else if(segment.compare(".") != 0) {
+                current = findChild(current, segment);
+            }
+        }
+        start = end + 1;
+    }
+
+    return current;
+}
+
+PathId PathTrie::parent(PathId id) const {
+    return node(id).parent;
+}
+
+PathId PathTrie::stem(PathId id) {
+    //The sibling without extension is created on first use and cached
+    if(node(id).stem == PATH_NONE) {
+        QString file = this->names.at(node(id).name);
+        int dot = file.lastIndexOf('.');
+        if(dot <= 0) {
+            node(id).stem = id;
+        } else {
+            PathId stemId = child(node(id).parent, file.left(dot));
+            node(id).stem = stemId;
+            if(node(stemId).stem == PATH_NONE) {
+                node(stemId).stem = stemId;
+            }
+        }
+    }
+
+    return node(id).stem;
+}
+
+const QString& PathTrie::name(PathId id) const {
+    return this->names.at(node(id).name);
+}
+
+bool PathTrie::isBelowBase(PathId id) const {
+    return node(id).belowBase;
+}
+
+QString PathTrie::path(PathId id) const {
+    return join(id, PATH_NONE);
+}
+
+QString PathTrie::relativePath(PathId id) const {
+    //Same result as stripping the parent of the base directory from the path
+    if(node(id).belowBase) {
+        return join(id, node(this->base).parent);
+    }
+
+    return join(id, PATH_NONE);
+}
+
+bool PathTrie::lessThan(PathId a, PathId b) const {
+    //Same order as comparing path(a) with path(b), without building the strings.
+    //The absolute root takes part as an empty leading name.
+    QVarLengthArray<PathId, 64> chainA;
+    QVarLengthArray<PathId, 64> chainB;
+    for(PathId current = a; current != PATH_NONE && current != this->relRoot;
+            current = node(current).parent) {
+        chainA.append(current);
+    }
+    for(PathId current = b; current != PATH_NONE && current != this->relRoot;
+            current = node(current).parent) {
+        chainB.append(current);
+    }
+
+    int i = chainA.count() - 1;
+    int j = chainB.count() - 1;
+    while(i >= 0 && j >= 0 && chainA.at(i) == chainB.at(j)) {
+        i--;
+        j--;
+    }
+    if(i < 0 || j < 0) {
+        return i < 0 && j >= 0;
+    }
+
+    //The first differing names decide, unless one is a prefix of the other.
+    //A separator follows every name but the last, and always the root.
+    const QString& nameA = this->names.at(node(chainA.at(i)).name);
+    const QString& nameB = this->names.at(node(chainB.at(j)).name);
+    int length = qMin(nameA.length(), nameB.length());
+    for(int k = 0; k < length; k++) {
+        if(nameA.at(k) != nameB.at(k)) {
+            return nameA.at(k) < nameB.at(k);
+        }
+    }
+
+    bool moreA = i > 0 || chainA.at(i) == this->absRoot;
+    bool moreB = j > 0 || chainB.at(j) == this->absRoot;
+    int nextA = nameA.length() > length ? nameA.at(length).unicode() : (moreA ? '/' : -1);
+    int nextB = nameB.length() > length ? nameB.at(length).unicode() : (moreB ? '/' : -1);
+    return nextA < nextB;
+}
+
+int PathTrie::count() const {
+    return this->nodeCount;
+}
+
+PathTrie::Node& PathTrie::node(PathId id) {
+    return this->blocks.at(id >> PATH_BLOCK_BITS)[id & PATH_BLOCK_MASK];
+}
+
+const PathTrie::Node& PathTrie::node(PathId id) const {
+    return this->blocks.at(id >> PATH_BLOCK_BITS)[id & PATH_BLOCK_MASK];
+}
+
+PathId PathTrie::child(PathId parent, const QString &name) {
+    int nameId = this->nameIndex.value(name, -1);
+    if(nameId == -1) {
+        nameId = this->names.count();
+        this->names.append(name);
+        this->nameIndex.insert(name, nameId);
+    }
+
+    quint64 key = (quint64(quint32(parent)) << 32) | quint32(nameId);
+    QHash<quint64, PathId>::const_iterator it = this->children.constFind(key);
+    if(it != this->children.constEnd()) {
+        return it.value();
+    }
+
+    if((this->nodeCount & PATH_BLOCK_MASK) == 0) {
+        this->blocks.append(new Node[PATH_BLOCK_SIZE]);
+    }
+    PathId id = this->nodeCount++;
+    Node& created = node(id);
+    created.parent = parent;
+    created.name = nameId;
+    created.stem = PATH_NONE;
+    created.belowBase = node(parent).belowBase;
+    this->children.insert(key, id);
+
+    return id;
+}
+
+PathId PathTrie::findChild(PathId parent, const QString &name) const {
+    int nameId = this->nameIndex.value(name, -1);
+    if(nameId == -1) {
+        return PATH_NONE;
+    }
+
+    quint64 key = (quint64(quint32(parent)) << 32) | quint32(nameId);
+    return this->children.value(key, PATH_NONE);
+}
+
+QString PathTrie::join(PathId id, PathId stop) const {
+    QVarLengthArray<PathId, 64> chain;
+    int length = 1;
+    PathId current = id;
+
+    while(current != stop && current != this->absRoot && current != this->relRoot) {
+        chain.append(current);
+        length += this->names.at(node(current).name).length() + 1;
+        current = node(current).parent;
+    }
+
+    bool absolute = current == this->absRoot && current != stop;
+    QString result;
+    result.reserve(length);
+    for(int i = chain.count() - 1; i >= 0; i--) {
+        if(absolute || i != chain.count() - 1) {
+            result += '/';
+        }
+        result += this->names.at(node(chain.at(i)).name);
+    }
+    if(result.isEmpty() && absolute) {
+        result = "/";
+    }
+
+    return result;
+}
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef PATHTRIE_H
+#define PATHTRIE_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+
+typedef int PathId;
+
+#define PATH_NONE       -1
+
+#define PATH_BLOCK_BITS 12
+#define PATH_BLOCK_SIZE (1 << PATH_BLOCK_BITS)
+#define PATH_BLOCK_MASK (PATH_BLOCK_SIZE - 1)
+
+/*
+ * Stores every path of the dependency graph as a node of a directory trie.
+ * A node only refers to its parent directory and an interned basename, so the
+ * common prefixes are stored once. Nodes live in fixed size blocks and are
+ * never moved, a PathId stays valid for the lifetime of the trie.
+ */
+class PathTrie {
+public:
+    PathTrie(const QString& baseDir);
+    ~PathTrie();
+
+    PathId insert(const QString& path);
+    PathId find(const QString& path) const;
+
+    PathId parent(PathId id) const;
+    PathId stem(PathId id);
+    const QString& name(PathId id) const;
+    bool isBelowBase(PathId id) const;
+
+    QString path(PathId id) const;
+    QString relativePath(PathId id) const;
+    bool lessThan(PathId a, PathId b) const;
+
+    int count() const;
+
+private:
+    struct Node {
+        PathId parent;
+        int name;
+        PathId stem;
+        bool belowBase;
+    };
+
+    Q_DISABLE_COPY(PathTrie)
+
+    Node& node(PathId id);
+    const Node& node(PathId id) const;
+    PathId child(PathId parent, const QString& name);
+    PathId findChild(PathId parent, const QString& name) const;
+    QString join(PathId id, PathId stop) const;
+
+    QList<Node*> blocks;
+    int nodeCount;
+    QVector<QString> names;
+    QHash<QString, int> nameIndex;
+    QHash<quint64, PathId> children;
+
+    PathId absRoot;
+    PathId relRoot;
+    PathId base;
+};
+
+#endif // PATHTRIE_H
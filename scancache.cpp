@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "scancache.h"
+
+#include <QFile>
+#include <QDataStream>
+
+QString ScanCache::fingerprint(const ConfigDTO &config) {
+    QStringList parts;
+    parts << config.srcPath << config.includePaths.join(",")
+          << QString::number(config.quoteType) << config.excludeIncludeRegEx
+          << (config.ignoreMissing ? "1" : "0");
+
+    return parts.join("\n");
+}
+
+bool ScanCache::load(const QString &file, const QString &fingerprint) {
+    QFile cacheFile(file);
+    this->entries.clear();
+    this->canonical.clear();
+
+    if(!cacheFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&cacheFile);
+    in.setVersion(QDataStream::Qt_4_8);
+    quint32 magic;
+    quint32 version;
+    QString storedFingerprint;
+    quint32 count;
+    in >> magic >> version;
+    if(magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+    in >> storedFingerprint >> count;
+    if(storedFingerprint != fingerprint) {
+        return false;
+    }
+
+    this->entries.reserve(int(count));
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString path;
+        CacheEntry entry;
+        in >> path >> entry.stamp.mtime >> entry.stamp.size >> entry.stamp.hash
+           >> entry.includes >> entry.targets;
+        this->entries.insert(path, entry);
+    }
+
+    in >> count;
+    this->canonical.reserve(int(count));
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString path;
+        FileId id;
+        in >> path >> id.device >> id.inode;
+        id.valid = true;
+        this->canonical.insert(id, path);
+    }
+
+    if(in.status() != QDataStream::Ok) {
+        this->entries.clear();
+        this->canonical.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool ScanCache::save(const QString &file, const QString &fingerprint) const {
+    QFile cacheFile(file);
+
+    if(!cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QDataStream out(&cacheFile);
+    out.setVersion(QDataStream::Qt_4_8);
+    out << quint32(CACHE_MAGIC) << quint32(CACHE_VERSION) << fingerprint
+        << quint32(this->entries.count());
+
+    QHash<QString, CacheEntry>::const_iterator it = this->entries.constBegin();
+    while(it != this->entries.constEnd()) {
+        const CacheEntry& entry = it.value();
+        out << it.key() << entry.stamp.mtime << entry.stamp.size << entry.stamp.hash
+            << entry.includes << entry.targets;
+        it++;
+    }
+
+    out << quint32(this->canonical.count());
+    QHash<FileId, QString>::const_iterator id = this->canonical.constBegin();
+    while(id != this->canonical.constEnd()) {
+        out << id.value() << id.key().device << id.key().inode;
+        id++;
+    }
+
+    return out.status() == QDataStream::Ok;
+}
+
+bool ScanCache::contains(const QString &path) const {
+    return this->entries.contains(path);
+}
+
+const CacheEntry& ScanCache::entry(const QString &path) const {
+    return *this->entries.constFind(path);
+}
+
+void ScanCache::insert(const QString &path, const CacheEntry &entry) {
+    this->entries.insert(path, entry);
+}
+
+QList<QString> ScanCache::paths() const {
+    return this->entries.keys();
+}
+
+int ScanCache::count() const {
+    return this->entries.count();
+}
+
+void ScanCache::insertCanonical(const FileId &id, const QString &path) {
+    if(id.valid) {
+        this->canonical.insert(id, path);
+    }
+}
+
+const QHash<FileId, QString>& ScanCache::canonicalPaths() const {
+    return this->canonical;
+}
@@ -0,0 +1,68 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SCANCACHE_H
+#define SCANCACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include "configdto.h"
+#include "fileidentity.h"
+
+#define CACHE_MAGIC     0x44455043
+#define CACHE_VERSION   2
+
+struct CacheEntry {
+    FileStamp stamp;
+    QStringList includes;
+    QStringList targets;
+};
+
+/*
+ * Scan results of a previous run, keyed by the absolute file path. Besides
+ * the stamp used for change detection every entry keeps the raw include
+ * directives and the files they were resolved to. The canonical path of
+ * every physical file seen by the scan is kept as well, so other paths
+ * reaching the same file can be mapped onto its node. The cache is only
+ * valid for the options it was written with, see fingerprint().
+ */
+class ScanCache {
+public:
+    static QString fingerprint(const ConfigDTO& config);
+
+    bool load(const QString& file, const QString& fingerprint);
+    bool save(const QString& file, const QString& fingerprint) const;
+
+    bool contains(const QString& path) const;
+    const CacheEntry& entry(const QString& path) const;
+    void insert(const QString& path, const CacheEntry& entry);
+    QList<QString> paths() const;
+    int count() const;
+
+    void insertCanonical(const FileId& id, const QString& path);
+    const QHash<FileId, QString>& canonicalPaths() const;
+
+private:
+    QHash<QString, CacheEntry> entries;
+    QHash<FileId, QString> canonical;
+};
+
+#endif // SCANCACHE_H
@@ -0,0 +1,623 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "svglayout.h"
+
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+
+#define SORT_UP     0x01
+#define SORT_DOWN   0x02
+
+struct SvgLayout::BarycenterLess {
+    const double* bary;
+
+    BarycenterLess(const double* bary) : bary(bary) {}
+
+    bool operator()(int a, int b) const {
+        return bary[a] < bary[b];
+    }
+};
+
+struct SvgLayout::LayerSorter {
+    typedef void result_type;
+
+    SvgLayout* layout;
+    int neighbours;
+
+    LayerSorter(SvgLayout* layout, int neighbours) : layout(layout), neighbours(neighbours) {}
+
+    void operator()(int layer) const {
+        layout->sortLayer(layer, neighbours);
+    }
+};
+
+struct SvgLayout::CrossingCounter {
+    typedef void result_type;
+
+    const SvgLayout* layout;
+    qint64* crossings;
+
+    CrossingCounter(const SvgLayout* layout, qint64* crossings)
+        : layout(layout), crossings(crossings) {}
+
+    void operator()(int layer) const {
+        crossings[layer] = layout->countCrossings(layer);
+    }
+};
+
+static QString escapeXml(const QString& text) {
+    QString escaped = text;
+    escaped.replace('&', "&amp;");
+    escaped.replace('<', "&lt;");
+    escaped.replace('>', "&gt;");
+    escaped.replace('"', "&quot;");
+
+    return escaped;
+}
+
+SvgLayout::SvgLayout() {
+    this->realCount = 0;
+    this->nodeCount = 0;
+    this->layerCount = 0;
+}
+
+int SvgLayout::addNode(const QString &label) {
+    this->labels.append(label);
+    this->nodeColors.append("white");
+
+    return this->realCount++;
+}
+
+void SvgLayout::setNodeColor(int node, const QString &color) {
+    this->nodeColors[node] = color;
+}
+
+void SvgLayout::addEdge(int from, int to, const QString &color) {
+    quint64 key = (quint64(quint32(from)) << 32) | quint32(to);
+    if(from == to || this->edgeSet.contains(key)) {
+        return;
+    }
+    this->edgeSet.insert(key);
+
+    int colorId = this->colorIndex.value(color, -1);
+    if(colorId == -1) {
+        colorId = this->colors.count();
+        this->colors.append(color);
+        this->colorIndex.insert(color, colorId);
+    }
+
+    Edge edge;
+    edge.from = from;
+    edge.to = to;
+    edge.color = colorId;
+    edge.reversed = false;
+    edge.firstDummy = 0;
+    edge.dummyCount = 0;
+    this->edges.append(edge);
+}
+
+void SvgLayout::layout() {
+    this->edgeSet.clear();
+
+    breakCycles();
+    assignLayers();
+    insertDummies();
+    orderLayers();
+    assignCoordinates();
+}
+
+void SvgLayout::write(QTextStream &out) const {
+    double maxX = 0.0;
+    for(int v = 0; v < this->realCount; v++) {
+        maxX = qMax(maxX, this->x.at(v) + width(v) / 2);
+    }
+    double svgWidth = maxX + SVG_MARGIN;
+    double svgHeight = layerY(qMax(this->layerCount - 1, 0)) + SVG_NODE_HEIGHT / 2
+            + SVG_MARGIN;
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" width=\""
+        << QString::number(svgWidth, 'f', 0) << "\" height=\""
+        << QString::number(svgHeight, 'f', 0) << "\" viewBox=\"0 0 "
+        << QString::number(svgWidth, 'f', 0) << " " << QString::number(svgHeight, 'f', 0)
+        << "\" font-family=\"Helvetica\" font-size=\"12\">\n";
+    out << "<title>source tree</title>\n";
+
+    //Edges are drawn first so the nodes cover their ends
+    out << "<g id=\"edges\" fill=\"none\">\n";
+    foreach(const Edge& edge, this->edges) {
+        QVector<double> points;
+        int from = tail(edge);
+        int to = head(edge);
+
+        points << this->x.at(from) << layerY(this->layer.at(from)) + SVG_NODE_HEIGHT / 2;
+        for(int i = 0; i < edge.dummyCount; i++) {
+            int dummy = edge.firstDummy + i;
+            points << this->x.at(dummy) << layerY(this->layer.at(dummy));
+        }
+        points << this->x.at(to) << layerY(this->layer.at(to)) - SVG_NODE_HEIGHT / 2;
+
+        if(edge.reversed) {
+            for(int i = 0, j = points.count() - 2; i < j; i += 2, j -= 2) {
+                qSwap(points[i], points[j]);
+                qSwap(points[i + 1], points[j + 1]);
+            }
+        }
+
+        //Shorten the last segment by the arrow head
+        int last = points.count() - 2;
+        double dx = points.at(last) - points.at(last - 2);
+        double dy = points.at(last + 1) - points.at(last - 1);
+        double length = sqrt(dx * dx + dy * dy);
+        if(length > 0.0) {
+            dx /= length;
+            dy /= length;
+        }
+        double tipX = points.at(last);
+        double tipY = points.at(last + 1);
+        points[last] = tipX - dx * SVG_ARROW_SIZE;
+        points[last + 1] = tipY - dy * SVG_ARROW_SIZE;
+
+        const QString& color = this->colors.at(edge.color);
+        out << "<polyline stroke=\"" << color << "\" points=\"";
+        for(int i = 0; i < points.count(); i += 2) {
+            out << QString::number(points.at(i), 'f', 1) << ","
+                << QString::number(points.at(i + 1), 'f', 1) << " ";
+        }
+        out << "\"/>\n";
+
+        double baseX = points.at(last);
+        double baseY = points.at(last + 1);
+        double halfX = -dy * SVG_ARROW_SIZE / 2;
+        double halfY = dx * SVG_ARROW_SIZE / 2;
+        out << "<polygon fill=\"" << color << "\" stroke=\"none\" points=\""
+            << QString::number(tipX, 'f', 1) << "," << QString::number(tipY, 'f', 1) << " "
+            << QString::number(baseX + halfX, 'f', 1) << ","
+            << QString::number(baseY + halfY, 'f', 1) << " "
+            << QString::number(baseX - halfX, 'f', 1) << ","
+            << QString::number(baseY - halfY, 'f', 1) << "\"/>\n";
+    }
+    out << "</g>\n";
+
+    out << "<g id=\"nodes\" stroke=\"black\">\n";
+    for(int v = 0; v < this->realCount; v++) {
+        double cx = this->x.at(v);
+        double cy = layerY(this->layer.at(v));
+        out << "<g><ellipse fill=\"" << this->nodeColors.at(v) << "\" cx=\""
+            << QString::number(cx, 'f', 1) << "\" cy=\"" << QString::number(cy, 'f', 1)
+            << "\" rx=\"" << QString::number(width(v) / 2, 'f', 1) << "\" ry=\""
+            << QString::number(SVG_NODE_HEIGHT / 2, 'f', 1) << "\"/>";
+        out << "<text stroke=\"none\" text-anchor=\"middle\" dominant-baseline=\"central\" x=\""
+            << QString::number(cx, 'f', 1) << "\" y=\"" << QString::number(cy, 'f', 1)
+            << "\">" << escapeXml(this->labels.at(v)) << "</text></g>\n";
+    }
+    out << "</g>\n";
+
+    out << "</svg>\n";
+    out.flush();
+}
+
+void SvgLayout::breakCycles() {
+    //Iterative DFS, edges leading back onto the DFS stack close a cycle
+    QVector<int> outStart(this->realCount + 1, 0);
+    QVector<int> outEdges(this->edges.count());
+    for(int e = 0; e < this->edges.count(); e++) {
+        outStart[this->edges.at(e).from + 1]++;
+    }
+    for(int v = 0; v < this->realCount; v++) {
+        outStart[v + 1] += outStart.at(v);
+    }
+    QVector<int> fill = outStart;
+    for(int e = 0; e < this->edges.count(); e++) {
+        outEdges[fill[this->edges.at(e).from]++] = e;
+    }
+
+    QVector<char> state(this->realCount, 0);
+    QVector<int> stackNode;
+    QVector<int> stackNext;
+    for(int start = 0; start < this->realCount; start++) {
+        if(state.at(start) != 0) {
+            continue;
+        }
+        state[start] = 1;
+        stackNode.append(start);
+        stackNext.append(outStart.at(start));
+
+        while(!stackNode.isEmpty()) {
+            int v = stackNode.last();
+            int& next = stackNext.last();
+            if(next < outStart.at(v + 1)) {
+                int e = outEdges.at(next);
+                next++;
+                int w = this->edges.at(e).to;
+                if(state.at(w) == 1) {
+                    this->edges[e].reversed = true;
+                } else if(state.at(w) == 0) {
+                    state[w] = 1;
+                    stackNode.append(w);
+                    stackNext.append(outStart.at(w));
+                }
+            } else {
+                state[v] = 2;
+                stackNode.removeLast();
+                stackNext.removeLast();
+            }
+        }
+    }
+}
+
+void SvgLayout::assignLayers() {
+    //Longest path layering in topological order
+    QVector<int> inDegree(this->realCount, 0);
+    QVector<int> outStart(this->realCount + 1, 0);
+    QVector<int> outList(this->edges.count());
+    foreach(const Edge& edge, this->edges) {
+        inDegree[head(edge)]++;
+        outStart[tail(edge) + 1]++;
+    }
+    for(int v = 0; v < this->realCount; v++) {
+        outStart[v + 1] += outStart.at(v);
+    }
+    QVector<int> fill = outStart;
+    foreach(const Edge& edge, this->edges) {
+        outList[fill[tail(edge)]++] = head(edge);
+    }
+
+    QVector<int> topo;
+    topo.reserve(this->realCount);
+    for(int v = 0; v < this->realCount; v++) {
+        if(inDegree.at(v) == 0) {
+            topo.append(v);
+        }
+    }
+    this->layer.fill(0, this->realCount);
+    for(int i = 0; i < topo.count(); i++) {
+        int v = topo.at(i);
+        for(int j = outStart.at(v); j < outStart.at(v + 1); j++) {
+            int w = outList.at(j);
+            this->layer[w] = qMax(this->layer.at(w), this->layer.at(v) + 1);
+            if(--inDegree[w] == 0) {
+                topo.append(w);
+            }
+        }
+    }
+
+    //Pull sources down next to their highest successor to shorten their edges
+    QVector<bool> hasParent(this->realCount, false);
+    foreach(const Edge& edge, this->edges) {
+        hasParent[head(edge)] = true;
+    }
+    for(int v = 0; v < this->realCount; v++) {
+        if(!hasParent.at(v) && outStart.at(v) != outStart.at(v + 1)) {
+            int top = INT_MAX;
+            for(int j = outStart.at(v); j < outStart.at(v + 1); j++) {
+                top = qMin(top, this->layer.at(outList.at(j)));
+            }
+            this->layer[v] = top - 1;
+        }
+    }
+
+    this->layerCount = 0;
+    for(int v = 0; v < this->realCount; v++) {
+        this->layerCount = qMax(this->layerCount, this->layer.at(v) + 1);
+    }
+}
+
+void SvgLayout::insertDummies() {
+    QVector<int> segmentFrom;
+    QVector<int> segmentTo;
+
+    this->nodeCount = this->realCount;
+    for(int e = 0; e < this->edges.count(); e++) {
+        Edge& edge = this->edges[e];
+        int from = tail(edge);
+        int to = head(edge);
+        int span = this->layer.at(to) - this->layer.at(from);
+
+        edge.firstDummy = this->nodeCount;
+        edge.dummyCount = span - 1;
+        if(span > SVG_MAX_SPAN) {
+            edge.dummyCount = 0;
+            continue;
+        }
+
+        int previous = from;
+        for(int i = 1; i < span; i++) {
+            int dummy = this->nodeCount++;
+            this->layer.append(this->layer.at(from) + i);
+            segmentFrom.append(previous);
+            segmentTo.append(dummy);
+            previous = dummy;
+        }
+        segmentFrom.append(previous);
+        segmentTo.append(to);
+    }
+
+    //Adjacency between neighbouring layers in compressed row form
+    this->upStart.fill(0, this->nodeCount + 1);
+    this->downStart.fill(0, this->nodeCount + 1);
+    for(int s = 0; s < segmentFrom.count(); s++) {
+        this->downStart[segmentFrom.at(s) + 1]++;
+        this->upStart[segmentTo.at(s) + 1]++;
+    }
+    for(int v = 0; v < this->nodeCount; v++) {
+        this->downStart[v + 1] += this->downStart.at(v);
+        this->upStart[v + 1] += this->upStart.at(v);
+    }
+    this->downList.resize(segmentFrom.count());
+    this->upList.resize(segmentFrom.count());
+    QVector<int> downFill = this->downStart;
+    QVector<int> upFill = this->upStart;
+    for(int s = 0; s < segmentFrom.count(); s++) {
+        this->downList[downFill[segmentFrom.at(s)]++] = segmentTo.at(s);
+        this->upList[upFill[segmentTo.at(s)]++] = segmentFrom.at(s);
+    }
+
+    this->layerStart.fill(0, this->layerCount + 1);
+    for(int v = 0; v < this->nodeCount; v++) {
+        this->layerStart[this->layer.at(v) + 1]++;
+    }
+    for(int l = 0; l < this->layerCount; l++) {
+        this->layerStart[l + 1] += this->layerStart.at(l);
+    }
+    this->order.resize(this->nodeCount);
+    this->pos.resize(this->nodeCount);
+    QVector<int> layerFill = this->layerStart;
+    for(int v = 0; v < this->nodeCount; v++) {
+        int index = layerFill[this->layer.at(v)]++;
+        this->order[index] = v;
+        this->pos[v] = index - this->layerStart.at(this->layer.at(v));
+    }
+    this->bary.fill(0.0, this->nodeCount);
+}
+
+void SvgLayout::orderLayers() {
+    //Initial order from a single top down sweep
+    for(int l = 1; l < this->layerCount; l++) {
+        sortLayer(l, SORT_UP);
+    }
+
+    if(this->layerCount < 2) {
+        return;
+    }
+
+    //Layers of the same parity do not share neighbours and are sorted in parallel
+    QVector<int> even;
+    QVector<int> odd;
+    QVector<int> pairs;
+    for(int l = 0; l < this->layerCount; l++) {
+        if(l % 2 == 0) {
+            even.append(l);
+        } else {
+            odd.append(l);
+        }
+        if(l + 1 < this->layerCount) {
+            pairs.append(l);
+        }
+    }
+
+    QVector<qint64> crossings(pairs.count(), 0);
+    QtConcurrent::blockingMap(pairs, CrossingCounter(this, crossings.data()));
+    qint64 best = 0;
+    foreach(qint64 count, crossings) {
+        best += count;
+    }
+    QVector<int> bestOrder(this->order.count());
+    std::copy(this->order.constBegin(), this->order.constEnd(), bestOrder.begin());
+
+    for(int round = 0; round < SVG_ORDER_ROUNDS && best > 0; round++) {
+        QtConcurrent::blockingMap(round % 2 == 0 ? odd : even,
+                                  LayerSorter(this, SORT_UP | SORT_DOWN));
+        QtConcurrent::blockingMap(round % 2 == 0 ? even : odd,
+                                  LayerSorter(this, SORT_UP | SORT_DOWN));
+
+        QtConcurrent::blockingMap(pairs, CrossingCounter(this, crossings.data()));
+        qint64 total = 0;
+        foreach(qint64 count, crossings) {
+            total += count;
+        }
+        if(total < best) {
+            best = total;
+            std::copy(this->order.constBegin(), this->order.constEnd(), bestOrder.begin());
+        }
+    }
+
+    std::copy(bestOrder.constBegin(), bestOrder.constEnd(), this->order.begin());
+    for(int l = 0; l < this->layerCount; l++) {
+        for(int i = this->layerStart.at(l); i < this->layerStart.at(l + 1); i++) {
+            this->pos[this->order.at(i)] = i - this->layerStart.at(l);
+        }
+    }
+}
+
+void SvgLayout::assignCoordinates() {
+    this->x.fill(0.0, this->nodeCount);
+
+    for(int l = 0; l < this->layerCount; l++) {
+        double cursor = SVG_MARGIN;
+        int previous = -1;
+        for(int i = this->layerStart.at(l); i < this->layerStart.at(l + 1); i++) {
+            int v = this->order.at(i);
+            if(previous == -1) {
+                this->x[v] = cursor + width(v) / 2;
+            } else {
+                this->x[v] = this->x.at(previous) + separation(previous, v);
+            }
+            previous = v;
+        }
+    }
+
+    for(int pass = 0; pass < SVG_COORD_PASSES; pass++) {
+        bool down = pass % 2 == 0;
+        for(int k = 0; k < this->layerCount; k++) {
+            placeLayer(down ? k : this->layerCount - 1 - k, down);
+        }
+    }
+
+    //Move the drawing back to the left margin
+    double minX = 0.0;
+    bool first = true;
+    for(int v = 0; v < this->nodeCount; v++) {
+        double left = this->x.at(v) - width(v) / 2;
+        if(first || left < minX) {
+            minX = left;
+            first = false;
+        }
+    }
+    for(int v = 0; v < this->nodeCount; v++) {
+        this->x[v] += SVG_MARGIN - minX;
+    }
+}
+
+void SvgLayout::sortLayer(int layer, int neighbours) {
+    int begin = this->layerStart.at(layer);
+    int end = this->layerStart.at(layer + 1);
+
+    for(int i = begin; i < end; i++) {
+        int v = this->order.at(i);
+        double sum = 0.0;
+        int count = 0;
+        if(neighbours & SORT_UP) {
+            for(int j = this->upStart.at(v); j < this->upStart.at(v + 1); j++) {
+                sum += this->pos.at(this->upList.at(j));
+                count++;
+            }
+        }
+        if(neighbours & SORT_DOWN) {
+            for(int j = this->downStart.at(v); j < this->downStart.at(v + 1); j++) {
+                sum += this->pos.at(this->downList.at(j));
+                count++;
+            }
+        }
+        this->bary[v] = count > 0 ? sum / count : this->pos.at(v);
+    }
+
+    std::stable_sort(this->order.begin() + begin, this->order.begin() + end,
+                     BarycenterLess(this->bary.constData()));
+    for(int i = begin; i < end; i++) {
+        this->pos[this->order.at(i)] = i - begin;
+    }
+}
+
+qint64 SvgLayout::countCrossings(int layer) const {
+    //Inversions of the edge targets counted with a Fenwick tree
+    int size = this->layerStart.at(layer + 2) - this->layerStart.at(layer + 1);
+    QVector<int> tree(size + 1, 0);
+    QVector<int> targets;
+    qint64 crossings = 0;
+    int inserted = 0;
+
+    for(int i = this->layerStart.at(layer); i < this->layerStart.at(layer + 1); i++) {
+        int v = this->order.at(i);
+        targets.clear();
+        for(int j = this->downStart.at(v); j < this->downStart.at(v + 1); j++) {
+            targets.append(this->pos.at(this->downList.at(j)));
+        }
+        std::sort(targets.begin(), targets.end());
+
+        foreach(int target, targets) {
+            int notGreater = 0;
+            for(int k = target + 1; k > 0; k -= k & -k) {
+                notGreater += tree.at(k);
+            }
+            crossings += inserted - notGreater;
+        }
+        foreach(int target, targets) {
+            for(int k = target + 1; k <= size; k += k & -k) {
+                tree[k]++;
+            }
+            inserted++;
+        }
+    }
+
+    return crossings;
+}
+
+void SvgLayout::placeLayer(int layer, bool down) {
+    int begin = this->layerStart.at(layer);
+    int count = this->layerStart.at(layer + 1) - begin;
+    const QVector<int>& start = down ? this->upStart : this->downStart;
+    const QVector<int>& list = down ? this->upList : this->downList;
+    QVector<double> desired(count);
+    QVector<double> left(count);
+    QVector<double> right(count);
+
+    for(int i = 0; i < count; i++) {
+        int v = this->order.at(begin + i);
+        if(start.at(v) == start.at(v + 1)) {
+            desired[i] = this->x.at(v);
+        } else {
+            double sum = 0.0;
+            for(int j = start.at(v); j < start.at(v + 1); j++) {
+                sum += this->x.at(list.at(j));
+            }
+            desired[i] = sum / (start.at(v + 1) - start.at(v));
+        }
+    }
+
+    //Pack once from the left and once from the right and use the mean of both
+    for(int i = 0; i < count; i++) {
+        left[i] = desired.at(i);
+        if(i > 0) {
+            left[i] = qMax(left.at(i), left.at(i - 1)
+                           + separation(this->order.at(begin + i - 1), this->order.at(begin + i)));
+        }
+    }
+    for(int i = count - 1; i >= 0; i--) {
+        right[i] = desired.at(i);
+        if(i < count - 1) {
+            right[i] = qMin(right.at(i), right.at(i + 1)
+                            - separation(this->order.at(begin + i), this->order.at(begin + i + 1)));
+        }
+    }
+    for(int i = 0; i < count; i++) {
+        this->x[this->order.at(begin + i)] = (left.at(i) + right.at(i)) / 2;
+    }
+}
+
+int SvgLayout::tail(const Edge &edge) const {
+    return edge.reversed ? edge.to : edge.from;
+}
+
+int SvgLayout::head(const Edge &edge) const {
+    return edge.reversed ? edge.from : edge.to;
+}
+
+double SvgLayout::width(int node) const {
+    if(node >= this->realCount) {
+        return 0.0;
+    }
+
+    return this->labels.at(node).length() * SVG_CHAR_WIDTH + SVG_NODE_PADDING;
+}
+
+double SvgLayout::separation(int left, int right) const {
+    double gap = (left >= this->realCount || right >= this->realCount)
+            ? SVG_DUMMY_GAP : SVG_NODE_GAP;
+
+    return (width(left) + width(right)) / 2 + gap;
+}
+
+double SvgLayout::layerY(int layer) const {
+    return SVG_MARGIN + SVG_NODE_HEIGHT / 2 + layer * SVG_LAYER_SPACING;
+}
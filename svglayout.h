@@ -0,0 +1,118 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by Sebastian Puschhof                              *
+ *   dev@puschhof.de                                                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SVGLAYOUT_H
+#define SVGLAYOUT_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QTextStream>
+
+#define SVG_MARGIN          20.0
+#define SVG_NODE_HEIGHT     36.0
+#define SVG_NODE_PADDING    24.0
+#define SVG_CHAR_WIDTH      7.0
+#define SVG_NODE_GAP        20.0
+#define SVG_DUMMY_GAP       8.0
+#define SVG_LAYER_SPACING   90.0
+#define SVG_ARROW_SIZE      8.0
+
+#define SVG_MAX_SPAN        8
+#define SVG_ORDER_ROUNDS    24
+#define SVG_COORD_PASSES    8
+
+/*
+ * Layered (Sugiyama style) layout of a directed graph written as SVG.
+ * The layout runs in four phases: cycles are broken by reversing DFS back
+ * edges, nodes are layered by longest path, the order inside the layers is
+ * improved by barycenter sweeps and finally x coordinates are balanced
+ * between the neighbouring layers. Edges spanning up to SVG_MAX_SPAN layers
+ * are routed through dummy nodes, longer edges are drawn as straight lines and
+ * do not take part in the crossing reduction, which keeps the number of dummy
+ * nodes linear in the number of edges.
+ */
+class SvgLayout {
+public:
+    SvgLayout();
+
+    int addNode(const QString& label);
+    void setNodeColor(int node, const QString& color);
+    void addEdge(int from, int to, const QString& color);
+
+    void layout();
+    void write(QTextStream& out) const;
+
+private:
+    struct Edge {
+        int from;
+        int to;
+        int color;
+        bool reversed;
+        int firstDummy;
+        int dummyCount;
+    };
+
+    struct BarycenterLess;
+    struct LayerSorter;
+    struct CrossingCounter;
+
+    void breakCycles();
+    void assignLayers();
+    void insertDummies();
+    void orderLayers();
+    void assignCoordinates();
+
+    void sortLayer(int layer, int neighbours);
+    qint64 countCrossings(int layer) const;
+    void placeLayer(int layer, bool down);
+
+    int tail(const Edge& edge) const;
+    int head(const Edge& edge) const;
+    double width(int node) const;
+    double separation(int left, int right) const;
+    double layerY(int layer) const;
+
+    QVector<QString> labels;
+    QVector<QString> nodeColors;
+    QVector<Edge> edges;
+    QVector<QString> colors;
+    QHash<QString, int> colorIndex;
+    QSet<quint64> edgeSet;
+
+    int realCount;
+    int nodeCount;
+    int layerCount;
+
+    QVector<int> layer;
+    QVector<int> pos;
+    QVector<double> bary;
+    QVector<double> x;
+
+    QVector<int> layerStart;
+    QVector<int> order;
+
+    QVector<int> upStart;
+    QVector<int> upList;
+    QVector<int> downStart;
+    QVector<int> downList;
+};
+
+#endif // SVGLAYOUT_H